@@ -8,6 +8,7 @@
 #include <yannpp/layers/crossentropyoutputlayer.h>
 #include <yannpp/layers/fullyconnectedlayer.h>
 #include <yannpp/layers/convolutionlayer.h>
+#include <yannpp/layers/convolutionlayer_pooling.h>
 #include <yannpp/layers/poolinglayer.h>
 #include <yannpp/network/network2.h>
 #include <yannpp/optimizer/sdg_optimizer.h>
@@ -47,16 +48,13 @@ int main(int argc, char* argv[]) {
     network2_t<float> network(
                 std::initializer_list<network2_t<float>::layer_type>(
     {
-                        std::make_shared<convolution_layer_2d_t<float>>(
+                        // convolution with relu and 2x2 max pooling (stride 2) in one pass
+                        std::make_shared<convolution_pooling_layer_t<float>>(
                         shape3d_t(28, 28, 1), // input size
                         shape3d_t(5, 5, 1), // filter size
                         10, // filters count
                         1, // stride length
-                        padding_type::valid,
-                        relu_activator),
-                        std::make_shared<pooling_layer_t<float>>(
-                        2, // window_size
-                        2), // stride length
+                        padding_type::valid),
                         /*std::make_shared<convolution_layer_loop_t<float>>(
                         shape3d_t(12, 12, 20), // input size
                         shape3d_t(5, 5, 20), // filter size
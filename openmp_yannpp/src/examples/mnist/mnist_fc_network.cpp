@@ -6,6 +6,7 @@
 #include <yannpp/common/array3d_math.h>
 #include <yannpp/layers/crossentropyoutputlayer.h>
 #include <yannpp/layers/fullyconnectedlayer.h>
+#include <yannpp/network/activations.h>
 #include <yannpp/network/activator.h>
 #include <yannpp/network/network2.h>
 #include <yannpp/optimizer/sdg_optimizer.h>
@@ -26,11 +27,10 @@ int main(int argc, char* argv[]) {
     float decay_rate = 20.f;
 
     auto training_data = mnist_dataset.training_data();
-    activator_t<float> sigmoid_activator(sigmoid_v<float>, sigmoid_derivative_v<float>);
+    // vectorized kernels, sigmoid derivative is computed from cached activation
+    activator_t<float> sigmoid_activator = make_sigmoid_activator<float>();
     // derivative returns 1 because it is cancelled out when using cross-entropy
-    activator_t<float> softmax_activator(stable_softmax_v<float>,
-                                          [](array3d_t<float> const &x){
-        return array3d_t<float>(shape_row(x.size()), 1.0);});
+    activator_t<float> softmax_activator = make_softmax_activator<float>();
 
     sdg_optimizer_t<float> sdg_optimizer(mini_batch_size,
                                          training_data.size(),
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector>
 
+#include <yannpp/common/allocator.h>
 #include <yannpp/common/array3d.h>
 #include <yannpp/common/array3d_math.h>
 #include <yannpp/common/shape.h>
@@ -35,6 +36,8 @@ array3d_t<float> func2(array3d_t<float> array){
 }
 
 int main() {
+    // weights matrix takes gigabytes, back it with huge pages to reduce TLB misses
+    set_default_memory_resource(huge_page_memory_resource());
 
     int input_shape = 40000;
     int output_shape = 40000;
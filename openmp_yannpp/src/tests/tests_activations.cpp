@@ -0,0 +1,75 @@
+#include <cmath>
+#include <limits>
+
+#include <gtest/gtest.h>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/network/activations.h>
+
+using namespace yannpp;
+
+TEST (ActivationsTests, FastExpTest) {
+    for (float x = -87.f; x < 88.f; x += 0.01f) {
+        const double expected = std::exp((double)x);
+        ASSERT_NEAR(1.0, fast_exp(x) / expected, 1e-6) << "exp(" << x << ")";
+    }
+
+    // out of range values are clamped to finite numbers
+    ASSERT_GT(fast_exp(-1000.f), 0.f);
+    ASSERT_LT(fast_exp(1000.f), std::numeric_limits<float>::infinity());
+}
+
+TEST (ActivationsTests, SigmoidTest) {
+    array3d_t<float> z(shape3d_t(1000, 1, 1), 0.f, 5.f);
+    auto a = fast_sigmoid_v(z);
+    auto d = fast_sigmoid_derivative_v(z);
+    auto d_cached = sigmoid_activation_derivative_v(a);
+
+    for (size_t i = 0; i < z.size(); i++) {
+        const float s = 1.f / (1.f + std::exp(-z(i)));
+        ASSERT_NEAR(s, a(i), 1e-6f);
+        ASSERT_NEAR(s * (1.f - s), d(i), 1e-6f);
+        ASSERT_NEAR(s * (1.f - s), d_cached(i), 1e-6f);
+    }
+}
+
+TEST (ActivationsTests, ReluTest) {
+    array3d_t<float> z(shape3d_t(10, 10, 3), 0.f, 1.f);
+    auto a = fast_relu_v(z);
+    auto d = relu_derivative_v(z);
+    ASSERT_EQ(z.shape(), a.shape());
+
+    for (size_t i = 0; i < z.size(); i++) {
+        ASSERT_FLOAT_EQ(z.data()[i] > 0 ? z.data()[i] : 0.f, a.data()[i]);
+        ASSERT_FLOAT_EQ(z.data()[i] > 0 ? 1.f : 0.f, d.data()[i]);
+    }
+}
+
+TEST (ActivationsTests, SoftmaxTest) {
+    array3d_t<float> z(shape3d_t(10, 1, 1), 0.f, 30.f);
+    auto a = fast_softmax_v(z);
+
+    double sum = 0;
+    for (size_t i = 0; i < z.size(); i++) { sum += std::exp((double)z(i)); }
+    for (size_t i = 0; i < z.size(); i++) {
+        ASSERT_NEAR(std::exp((double)z(i)) / sum, a(i), 1e-6);
+    }
+}
+
+TEST (ActivationsTests, CachedDerivativeTest) {
+    auto activator = make_sigmoid_activator<float>();
+    ASSERT_EQ(derivative_arg::activation, activator.get_derivative_arg());
+
+    array3d_t<float> z(shape3d_t(100, 1, 1), 0.f, 2.f);
+    array3d_t<float> error(shape3d_t(100, 1, 1), 1.f, 1.f);
+    array3d_t<float> cache;
+    auto a = activator.activate(z, cache);
+    auto delta = activator.delta(z, cache, error.clone());
+    auto delta_uncached = activator.delta(z, error.clone());
+
+    for (size_t i = 0; i < z.size(); i++) {
+        ASSERT_FLOAT_EQ(a(i), cache(i));
+        ASSERT_FLOAT_EQ(a(i) * (1.f - a(i)) * error(i), delta(i));
+        ASSERT_FLOAT_EQ(delta(i), delta_uncached(i));
+    }
+}
@@ -0,0 +1,112 @@
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <yannpp/common/allocator.h>
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+
+using namespace yannpp;
+
+namespace {
+    class counting_memory_resource_t: public aligned_memory_resource_t {
+    public:
+        virtual void *allocate(size_t bytes) override {
+            allocated_ += bytes;
+            return aligned_memory_resource_t::allocate(bytes);
+        }
+
+        size_t allocated() const { return allocated_; }
+
+    private:
+        size_t allocated_ = 0;
+    };
+
+    bool is_aligned(void const *p, size_t alignment) {
+        return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+    }
+}
+
+TEST (ArrayTests, StorageIsAlignedTest) {
+    for (int size = 1; size < 100; size += 7) {
+        array3d_t<float> a(shape3d_t(size, 3, 1), 1.f);
+        ASSERT_TRUE(is_aligned(a.raw(), array_alignment));
+
+        array4d_t<double> b(3, shape3d_t(size, 1, 1), 1.0);
+        ASSERT_TRUE(is_aligned(b.raw(), array_alignment));
+    }
+}
+
+TEST (ArrayTests, MemoryResourceTest) {
+    counting_memory_resource_t resource;
+    set_default_memory_resource(&resource);
+    {
+        array3d_t<float> a(shape3d_t(10, 10, 1), 0.f);
+        // copies are allocated from the same resource
+        array3d_t<float> b(a);
+        ASSERT_EQ(2 * 100 * sizeof(float), resource.allocated());
+    }
+    set_default_memory_resource(nullptr);
+    ASSERT_EQ(aligned_memory_resource(), get_default_memory_resource());
+
+    array3d_t<float> c(shape3d_t(10, 10, 1), 0.f);
+    ASSERT_EQ(2 * 100 * sizeof(float), resource.allocated());
+}
+
+TEST (ArrayTests, HugePagesTest) {
+    huge_page_memory_resource_t resource(1024);
+    set_default_memory_resource(&resource);
+    array3d_t<float> small(shape3d_t(10, 1, 1), 1.f);
+    array3d_t<float> big(shape3d_t(1000, 1000, 1), 1.f);
+    set_default_memory_resource(nullptr);
+
+    ASSERT_TRUE(is_aligned(small.raw(), array_alignment));
+    ASSERT_TRUE(is_aligned(big.raw(), huge_page_size));
+    ASSERT_FLOAT_EQ(1000 * 1000, big.sum());
+}
+
+TEST (ArrayTests, WindowViewTest) {
+    array3d_t<int> a(shape3d_t(4, 5, 3), 0);
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 5; y++) {
+            for (int z = 0; z < 3; z++) { a(x, y, z) = x * 100 + y * 10 + z; }
+        }
+    }
+
+    view3d_t<int const> v = a.view();
+    ASSERT_TRUE(v.is_contiguous());
+
+    auto w = v.window(index3d_t(1, 2, 1), shape3d_t(2, 3, 2));
+    ASSERT_FALSE(w.is_contiguous());
+    for (int x = 0; x < 2; x++) {
+        for (int y = 0; y < 3; y++) {
+            for (int z = 0; z < 2; z++) {
+                ASSERT_EQ(a(x + 1, y + 2, z + 1), w(x, y, z));
+            }
+            ASSERT_EQ(&a(x + 1, y + 2, 1), w.ptr(x, y));
+        }
+    }
+
+    auto slice = a.slice(index3d_t(1, 2, 1), index3d_t(2, 4, 2));
+    ASSERT_EQ(w.data(), slice.view().data());
+    ASSERT_EQ(w.shape(), slice.view().shape());
+}
+
+TEST (ArrayTests, ExpressionTest) {
+    array3d_t<float> a(shape3d_t(100, 100, 1), 1.f, 2.f);
+    array3d_t<float> b(shape3d_t(100, 100, 1), -1.f, 3.f);
+    array3d_t<float> expected = a.clone();
+    expected.mul(0.5f).add(b.clone().mul(-2.f)).element_mul(b);
+
+    // in place, a is used on both sides
+    a.assign((0.5f * a - b * 2.f) * b);
+    for (size_t i = 0; i < a.size(); i++) {
+        ASSERT_FLOAT_EQ(expected.data()[i], a.data()[i]);
+    }
+
+    array3d_t<float> c(shape3d_t(10, 1000, 1), elementwise(b / 2.f, [](float x) { return x + 1.f; }));
+    ASSERT_EQ(shape3d_t(10, 1000, 1), c.shape());
+    for (size_t i = 0; i < c.size(); i++) {
+        ASSERT_FLOAT_EQ(b.data()[i] / 2.f + 1.f, c.data()[i]);
+    }
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <yannpp/common/execution_context.h>
+#include <yannpp/common/parallel_for.h>
+#include <yannpp/common/thread_scratch.h>
+#include <yannpp/layers/poolinglayer.h>
+#include <yannpp/network/network2.h>
+
+TEST (ExecutionContextTests, ThresholdsTest) {
+    using namespace yannpp;
+
+    execution_context_t context(6);
+    context.set_threshold(parallel_op::convolution, 1000);
+
+    ASSERT_EQ(context.threads(), 6);
+    ASSERT_EQ(context.threads_for(parallel_op::convolution, 999), 1);
+    ASSERT_EQ(context.threads_for(parallel_op::convolution, 1000), 6);
+    ASSERT_EQ(context.threads_for(parallel_op::gemm, 0), 1);
+    ASSERT_GT(execution_context_t().threads(), 0);
+}
+
+TEST (ExecutionContextTests, FromEnvironmentTest) {
+    using namespace yannpp;
+
+    setenv("YANNPP_NUM_THREADS", "3", 1);
+    setenv("YANNPP_AFFINITY", "scatter", 1);
+    setenv("YANNPP_POOLING_THRESHOLD", "12345", 1);
+    execution_context_t context = execution_context_t::from_environment();
+    unsetenv("YANNPP_NUM_THREADS");
+    unsetenv("YANNPP_AFFINITY");
+    unsetenv("YANNPP_POOLING_THRESHOLD");
+
+    ASSERT_EQ(context.threads(), 3);
+    ASSERT_EQ(context.affinity(), affinity_type::scatter);
+    ASSERT_EQ(context.threshold(parallel_op::pooling), 12345u);
+    ASSERT_EQ(context.threshold(parallel_op::gemm), execution_context_t().threshold(parallel_op::gemm));
+}
+
+TEST (ExecutionContextTests, NetworkSharesContextTest) {
+    using namespace yannpp;
+
+    auto layer = std::make_shared<pooling_layer_t<float>>(2, 2);
+    ASSERT_EQ(&layer->get_execution_context(), &get_default_execution_context());
+
+    network2_t<float> network({layer}, execution_context_t(2));
+    ASSERT_EQ(&layer->get_execution_context(), &network.get_execution_context());
+    ASSERT_EQ(layer->get_execution_context().threads(), 2);
+
+    network.set_execution_context(execution_context_t(5));
+    ASSERT_EQ(layer->get_execution_context().threads(), 5);
+}
+
+TEST (ExecutionContextTests, ParallelForVisitsAllTest) {
+    using namespace yannpp;
+
+    execution_context_t context(4);
+    context.set_threshold(parallel_op::elementwise, 0);
+    const schedule_type schedules[] = {schedule_type::blocked, schedule_type::dynamic, schedule_type::guided};
+
+    for (auto schedule: schedules) {
+        for (size_t grain = 1; grain <= 7; grain += 3) {
+            std::vector<int> visited(101, 0);
+            parallel_for(context, parallel_op::elementwise, visited.size(), 3, visited.size(),
+                         [&](size_t i) { visited[i]++; },
+                         grain, schedule);
+            for (size_t i = 0; i < visited.size(); i++) {
+                ASSERT_EQ(visited[i], (i < 3) ? 0 : 1) << "Index " << i << " grain " << grain;
+            }
+        }
+    }
+}
+
+TEST (ExecutionContextTests, ParallelFor2DTest) {
+    using namespace yannpp;
+
+    execution_context_t context(3);
+    context.set_threshold(parallel_op::pooling, 0);
+    std::vector<int> visited(5 * 7, 0);
+    parallel_for_2d(context, parallel_op::pooling, visited.size(), 5, 7,
+                    [&](size_t i, size_t j) { visited[i * 7 + j] += 1 + (int)j; });
+    for (size_t i = 0; i < visited.size(); i++) {
+        ASSERT_EQ(visited[i], 1 + (int)(i % 7));
+    }
+}
+
+TEST (ExecutionContextTests, ParallelForSerialFallbackTest) {
+    using namespace yannpp;
+
+    execution_context_t context(4);
+    context.set_threshold(parallel_op::gemm, 1000);
+    std::vector<int> threads(10, -1);
+    parallel_for(context, parallel_op::gemm, 999, 0, threads.size(),
+                 [&](size_t i) { threads[i] = omp_get_num_threads(); });
+    for (auto t: threads) { ASSERT_EQ(t, 1); }
+}
+
+TEST (ExecutionContextTests, ThreadScratchTest) {
+    using namespace yannpp;
+
+    execution_context_t context(2);
+    context.set_threshold(parallel_op::elementwise, 0);
+    thread_scratch_t<float> scratch;
+
+    // every thread of the loop gets its own slot
+    std::vector<float *> slots(16, nullptr);
+    scratch.prepare(context, 8);
+    parallel_for(context, parallel_op::elementwise, slots.size(), 0, slots.size(),
+                 [&](size_t i) { slots[i] = scratch.data(); std::fill(slots[i], slots[i] + 8, 1.f); });
+    ASSERT_NE(slots.front(), slots.back());
+
+    // inside of a bigger team the loop runs in the calling thread (its number may exceed threads of the context)
+    std::vector<float *> nested(16, nullptr);
+#   pragma omp parallel num_threads(4)
+{
+    if (omp_get_thread_num() == omp_get_num_threads() - 1) {
+        scratch.prepare(context, 8);
+        parallel_for(context, parallel_op::elementwise, nested.size(), 0, nested.size(),
+                     [&](size_t i) { nested[i] = scratch.data(); std::fill(nested[i], nested[i] + 8, 2.f); });
+    }
+}
+    ASSERT_NE(nested.front(), nullptr);
+    for (auto p: nested) { ASSERT_EQ(nested.front(), p); }
+}
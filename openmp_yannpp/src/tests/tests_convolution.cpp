@@ -1,13 +1,30 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <gtest/gtest.h>
+#include <omp.h>
 
 #include <yannpp/common/array3d.h>
 #include <yannpp/common/array3d_math.h>
+#include <yannpp/common/array4d.h>
 #include <yannpp/common/log.h>
 #include <yannpp/layers/convolutionlayer.h>
+#include <yannpp/layers/convolutionlayer_auto.h>
+#include <yannpp/layers/convolutionlayer_blocked.h>
+#include <yannpp/layers/convolutionlayer_depthwise.h>
+#include <yannpp/layers/convolutionlayer_fft.h>
+#include <yannpp/layers/convolutionlayer_pointwise.h>
+#include <yannpp/layers/convolutionlayer_pooling.h>
+#include <yannpp/layers/convolutionlayer_winograd.h>
+#include <yannpp/layers/poolinglayer.h>
+#include <yannpp/network/activation_policies.h>
+#include <yannpp/network/activations.h>
 #include <yannpp/optimizer/optimizer.h>
 
 static yannpp::activator_t<float> relu_activator(yannpp::relu_v<float>, yannpp::relu_v<float>);
@@ -42,6 +59,26 @@ bool arrays_equal(yannpp::array3d_t<float> const &a, yannpp::array3d_t<float> co
     return equal;
 }
 
+// input gradients sum many products of large values, so the two layers
+// only agree up to float rounding relative to the magnitude
+bool arrays_relatively_equal(yannpp::array3d_t<float> const &a, yannpp::array3d_t<float> const &b,
+                             float tolerance = 1e-5f) {
+    if (a.shape() != b.shape()) { return false; }
+
+    auto &adata = a.data();
+    auto &bdata = b.data();
+    const size_t size = adata.size();
+    for (size_t i = 0; i < size; i++) {
+        const float scale = std::max(1.f, std::max(std::fabs(adata[i]), std::fabs(bdata[i])));
+        if (fabs(adata[i] - bdata[i]) > tolerance * scale) {
+            yannpp::log("Difference at %d: %.6f != %.6f", i, adata[i], bdata[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int fill_array(yannpp::array3d_t<float> &arr, int start=0) {
     int i = start;
     auto slice = arr.slice();
@@ -442,7 +479,7 @@ TEST (ConvolutionTests, ErrorBackpropagateMoreThanOnceTest) {
         loop->feedforward(input2.clone());
         auto el = loop->backpropagate(error2.clone());
 
-        ASSERT_TRUE(arrays_equal(em, el)) << "Errors differ after iteration " << i;
+        ASSERT_TRUE(arrays_relatively_equal(em, el)) << "Errors differ after iteration " << i;
     }
 }
 
@@ -456,8 +493,8 @@ TEST (ConvolutionTests, ErrorBackpropagateWithSamePaddingTest) {
     ASSERT_TRUE(loop->get_output_shape() == matrix->get_output_shape());
 
     auto error = create_error(loop->get_output_shape());
-    ASSERT_TRUE(arrays_equal(loop->backpropagate(error.clone()),
-                             matrix->backpropagate(error.clone())));
+    ASSERT_TRUE(arrays_relatively_equal(loop->backpropagate(error.clone()),
+                                        matrix->backpropagate(error.clone())));
 }
 
 TEST (ConvolutionTests, ErrorBackpropagateWithValidPaddingTest) {
@@ -470,6 +507,543 @@ TEST (ConvolutionTests, ErrorBackpropagateWithValidPaddingTest) {
     ASSERT_TRUE(loop->get_output_shape() == matrix->get_output_shape());
 
     auto error = create_error(loop->get_output_shape());
-    ASSERT_TRUE(arrays_equal(loop->backpropagate(error.clone()),
-                             matrix->backpropagate(error.clone())));
+    ASSERT_TRUE(arrays_relatively_equal(loop->backpropagate(error.clone()),
+                                        matrix->backpropagate(error.clone())));
+}
+
+template<typename Layer>
+void check_batch_matches_samples(yannpp::padding_type padding) {
+    using namespace yannpp;
+
+    shape3d_t filter_shape(3, 3, 5);
+    shape3d_t input_shape(15, 15, 5);
+    int filters_number = 10;
+    int stride_length = 1;
+    const size_t batch_size = 3;
+
+    Layer single(input_shape, filter_shape, filters_number, stride_length, padding, relu_activator);
+    single.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    single.init();
+
+    Layer batched(input_shape, filter_shape, filters_number, stride_length, padding, relu_activator);
+    batched.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    batched.init();
+
+    std::vector<array3d_t<float>> inputs;
+    for (size_t n = 0; n < batch_size; n++) {
+        inputs.emplace_back(input_shape, 1.f + n);
+    }
+
+    auto output = batched.feedforward_batch(array4d_t<float>(inputs));
+    auto error = create_error(single.get_output_shape());
+    batched.backpropagate_batch(array4d_t<float>(std::vector<array3d_t<float>>(batch_size, error.clone())));
+
+    ASSERT_EQ(output.batch_size(), batch_size);
+    for (size_t n = 0; n < batch_size; n++) {
+        ASSERT_TRUE(arrays_equal(single.feedforward(inputs[n].clone()), output.get(n))) << "Outputs differ for sample " << n;
+        single.backpropagate(error.clone());
+    }
+
+    fake_optimizer_t single_optimizer, batched_optimizer;
+    single.optimize(single_optimizer);
+    batched.optimize(batched_optimizer);
+
+    auto &single_nabla_w = single_optimizer.get_nabla_w();
+    auto &batched_nabla_w = batched_optimizer.get_nabla_w();
+    ASSERT_EQ(single_nabla_w.size(), batched_nabla_w.size());
+    for (size_t i = 0; i < single_nabla_w.size(); i++) {
+        ASSERT_TRUE(arrays_equal(single_nabla_w[i], batched_nabla_w[i])) << "Arrays are not equal at " << i;
+    }
+}
+
+TEST (ConvolutionTests, LoopBatchMatchesSamplesTest) {
+    check_batch_matches_samples<yannpp::convolution_layer_loop_t<float>>(yannpp::padding_type::same);
+}
+
+TEST (ConvolutionTests, MatrixBatchMatchesSamplesTest) {
+    check_batch_matches_samples<yannpp::convolution_layer_2d_t<float>>(yannpp::padding_type::valid);
+}
+
+TEST (ConvolutionTests, ActivationPolicyMatchesActivatorTest) {
+    using namespace yannpp;
+
+    shape3d_t filter_shape(3, 3, 5);
+    shape3d_t input_shape(15, 15, 5);
+    int filters_number = 10;
+    int stride_length = 1;
+    auto activator = make_relu_activator<float>();
+
+    convolution_layer_loop_t<float> runtime(input_shape, filter_shape, filters_number, stride_length, padding_type::same, activator);
+    runtime.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    runtime.init();
+
+    convolution_layer_loop_t<float, relu_activation_t> policy(input_shape, filter_shape, filters_number, stride_length, padding_type::same);
+    policy.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    policy.init();
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    ASSERT_TRUE(arrays_equal(runtime.feedforward(input.clone()), policy.feedforward(input.clone())));
+
+    auto error = create_error(runtime.get_output_shape());
+    ASSERT_TRUE(arrays_equal(runtime.backpropagate(error.clone()), policy.backpropagate(error.clone())));
+
+    fake_optimizer_t runtime_optimizer, policy_optimizer;
+    runtime.optimize(runtime_optimizer);
+    policy.optimize(policy_optimizer);
+
+    auto &runtime_nabla_w = runtime_optimizer.get_nabla_w();
+    auto &policy_nabla_w = policy_optimizer.get_nabla_w();
+    ASSERT_EQ(runtime_nabla_w.size(), policy_nabla_w.size());
+    for (size_t i = 0; i < runtime_nabla_w.size(); i++) {
+        ASSERT_TRUE(arrays_equal(runtime_nabla_w[i], policy_nabla_w[i])) << "Arrays are not equal at " << i;
+    }
+}
+
+// fast convolutions change rounding so outputs are compared relatively
+bool arrays_near(float const *a, float const *b, size_t size, float tolerance) {
+    float max_value = 0.f;
+    for (size_t i = 0; i < size; i++) { max_value = std::max(max_value, (float)fabs(a[i])); }
+    for (size_t i = 0; i < size; i++) {
+        if (fabs(a[i] - b[i]) > tolerance * max_value) {
+            yannpp::log("Difference at %d: %.6f != %.6f", i, a[i], b[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Layer has to produce same results as convolution_layer_loop_t up to rounding
+template<typename Layer>
+void check_matches_loop(yannpp::padding_type padding, int filter_size = 3, int stride = 1) {
+    using namespace yannpp;
+
+    shape3d_t filter_shape(filter_size, filter_size, 5);
+    shape3d_t input_shape(15, 13, 5);
+    int filters_number = 10;
+
+    convolution_layer_loop_t<float> loop(input_shape, filter_shape, filters_number, stride, padding, relu_activator);
+    loop.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    loop.init();
+
+    Layer layer(input_shape, filter_shape, filters_number, stride, padding, relu_activator);
+    layer.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    layer.init();
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    auto lo = loop.feedforward(input.clone());
+    auto wo = layer.feedforward(input.clone());
+    ASSERT_TRUE(arrays_near(lo.raw(), wo.raw(), lo.size(), 1e-5f));
+
+    array3d_t<float> error(loop.get_output_shape(), -1.f, 1.f);
+    auto ld = loop.backpropagate(error.clone());
+    auto wd = layer.backpropagate(error.clone());
+    ASSERT_TRUE(arrays_near(ld.raw(), wd.raw(), ld.size(), 1e-5f));
+
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(loop.get_output_shape(), -1.f, 1.f);
+    }
+    auto lbo = loop.feedforward_batch(array4d_t<float>(inputs));
+    auto wbo = layer.feedforward_batch(array4d_t<float>(inputs));
+    ASSERT_TRUE(arrays_near(lbo.raw(), wbo.raw(), lbo.size(), 1e-5f));
+
+    auto lbd = loop.backpropagate_batch(array4d_t<float>(errors));
+    auto wbd = layer.backpropagate_batch(array4d_t<float>(errors));
+    ASSERT_TRUE(arrays_near(lbd.raw(), wbd.raw(), lbd.size(), 1e-5f));
+
+    // cached filters have to be updated after weights change
+    fake_optimizer_t loop_optimizer, layer_optimizer;
+    loop.optimize(loop_optimizer);
+    layer.optimize(layer_optimizer);
+    ASSERT_EQ(loop_optimizer.get_nabla_w().size(), layer_optimizer.get_nabla_w().size());
+    for (size_t i = 0; i < loop_optimizer.get_nabla_w().size(); i++) {
+        auto &lw = loop_optimizer.get_nabla_w()[i];
+        auto &ww = layer_optimizer.get_nabla_w()[i];
+        ASSERT_TRUE(arrays_near(lw.raw(), ww.raw(), lw.size(), 1e-5f)) << "Arrays are not equal at " << i;
+    }
+
+    std::vector<array3d_t<float>> weights, biases;
+    for (int i = 0; i < filters_number; i++) {
+        weights.emplace_back(filter_shape, -1.f, 1.f);
+        biases.emplace_back(shape_row(1), -1.f, 1.f);
+    }
+    std::vector<array3d_t<float>> weights_copy, biases_copy;
+    for (int i = 0; i < filters_number; i++) {
+        weights_copy.push_back(weights[i].clone());
+        biases_copy.push_back(biases[i].clone());
+    }
+    loop.load(std::move(weights), std::move(biases));
+    layer.load(std::move(weights_copy), std::move(biases_copy));
+
+    lo = loop.feedforward(input.clone());
+    wo = layer.feedforward(input.clone());
+    ASSERT_TRUE(arrays_near(lo.raw(), wo.raw(), lo.size(), 1e-5f));
+}
+
+TEST (ConvolutionTests, WinogradF2MatchesLoopTest) {
+    using winograd_layer = yannpp::convolution_layer_winograd_t<float, yannpp::activator_t<float>, 2>;
+    check_matches_loop<winograd_layer>(yannpp::padding_type::same);
+    check_matches_loop<winograd_layer>(yannpp::padding_type::valid);
+}
+
+TEST (ConvolutionTests, WinogradF4MatchesLoopTest) {
+    using winograd_layer = yannpp::convolution_layer_winograd_t<float, yannpp::activator_t<float>, 4>;
+    check_matches_loop<winograd_layer>(yannpp::padding_type::same);
+    check_matches_loop<winograd_layer>(yannpp::padding_type::valid);
+}
+
+TEST (ConvolutionTests, FftMatchesLoopTest) {
+    using fft_layer = yannpp::convolution_layer_fft_t<float>;
+    check_matches_loop<fft_layer>(yannpp::padding_type::same, 3);
+    check_matches_loop<fft_layer>(yannpp::padding_type::same, 7);
+    check_matches_loop<fft_layer>(yannpp::padding_type::valid, 7);
+}
+
+TEST (ConvolutionTests, FftSingleForwardBetweenBatchPassesTest) {
+    using namespace yannpp;
+
+    shape3d_t filter_shape(5, 5, 3);
+    shape3d_t input_shape(12, 10, 3);
+    int filters_number = 4;
+
+    convolution_layer_loop_t<float> loop(input_shape, filter_shape, filters_number, 1, padding_type::same, relu_activator);
+    loop.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    loop.init();
+
+    convolution_layer_fft_t<float> layer(input_shape, filter_shape, filters_number, 1, padding_type::same, relu_activator);
+    layer.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    layer.init();
+
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(loop.get_output_shape(), -1.f, 1.f);
+    }
+    loop.feedforward_batch(array4d_t<float>(inputs));
+    layer.feedforward_batch(array4d_t<float>(inputs));
+
+    // single sample pass (e.g. evaluation) must not replace spectra of the minibatch
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    loop.feedforward(input.clone());
+    layer.feedforward(input.clone());
+
+    auto lbd = loop.backpropagate_batch(array4d_t<float>(errors));
+    auto wbd = layer.backpropagate_batch(array4d_t<float>(errors));
+    ASSERT_TRUE(arrays_near(lbd.raw(), wbd.raw(), lbd.size(), 1e-5f));
+
+    fake_optimizer_t loop_optimizer, layer_optimizer;
+    loop.optimize(loop_optimizer);
+    layer.optimize(layer_optimizer);
+    for (size_t i = 0; i < loop_optimizer.get_nabla_w().size(); i++) {
+        auto &lw = loop_optimizer.get_nabla_w()[i];
+        auto &ww = layer_optimizer.get_nabla_w()[i];
+        ASSERT_TRUE(arrays_near(lw.raw(), ww.raw(), lw.size(), 1e-5f)) << "Arrays are not equal at " << i;
+    }
+}
+
+TEST (ConvolutionTests, BlockedMatchesLoopTest) {
+    using blocked_layer = yannpp::convolution_layer_blocked_t<float>;
+    check_matches_loop<blocked_layer>(yannpp::padding_type::same, 3);
+    check_matches_loop<blocked_layer>(yannpp::padding_type::valid, 5);
+    check_matches_loop<blocked_layer>(yannpp::padding_type::same, 3, 2);
+}
+
+TEST (ConvolutionTests, MatrixMatchesLoopWithStrideTest) {
+    using matrix_layer = yannpp::convolution_layer_2d_t<float>;
+    check_matches_loop<matrix_layer>(yannpp::padding_type::same, 3, 2);
+    check_matches_loop<matrix_layer>(yannpp::padding_type::valid, 5, 2);
+}
+
+// compares forward, backward (single and batch) and gradients of two layers
+// that were loaded with equivalent weights
+template<typename Reference, typename Layer>
+void check_same_results(Reference &reference, Layer &layer,
+                        yannpp::shape3d_t const &input_shape,
+                        fake_optimizer_t &reference_optimizer, fake_optimizer_t &layer_optimizer) {
+    using namespace yannpp;
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    auto ro = reference.feedforward(input.clone());
+    auto o = layer.feedforward(input.clone());
+    ASSERT_EQ(ro.shape(), o.shape());
+    ASSERT_TRUE(arrays_near(ro.raw(), o.raw(), ro.size(), 1e-5f));
+
+    array3d_t<float> error(reference.get_output_shape(), -1.f, 1.f);
+    auto rd = reference.backpropagate(error.clone());
+    auto d = layer.backpropagate(error.clone());
+    ASSERT_TRUE(arrays_near(rd.raw(), d.raw(), rd.size(), 1e-5f));
+
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(reference.get_output_shape(), -1.f, 1.f);
+    }
+    auto rbo = reference.feedforward_batch(array4d_t<float>(inputs));
+    auto bo = layer.feedforward_batch(array4d_t<float>(inputs));
+    ASSERT_TRUE(arrays_near(rbo.raw(), bo.raw(), rbo.size(), 1e-5f));
+
+    auto rbd = reference.backpropagate_batch(array4d_t<float>(errors));
+    auto bd = layer.backpropagate_batch(array4d_t<float>(errors));
+    ASSERT_TRUE(arrays_near(rbd.raw(), bd.raw(), rbd.size(), 1e-5f));
+
+    reference.optimize(reference_optimizer);
+    layer.optimize(layer_optimizer);
+
+    auto &rb = reference_optimizer.get_nabla_b();
+    auto &b = layer_optimizer.get_nabla_b();
+    ASSERT_EQ(rb.size(), b.size());
+    for (size_t i = 0; i < rb.size(); i++) {
+        ASSERT_EQ(rb[i].size(), b[i].size());
+        for (size_t j = 0; j < rb[i].size(); j++) {
+            const float expected = rb[i].raw()[j];
+            ASSERT_NEAR(expected, b[i].raw()[j], 1e-4f * std::max(1.f, (float)fabs(expected))) << "Biases are not equal at " << j;
+        }
+    }
+}
+
+void check_depthwise_matches_matrix(yannpp::padding_type padding, int filter_size, int stride) {
+    using namespace yannpp;
+
+    const int depth = 6;
+    shape3d_t input_shape(15, 13, depth);
+    shape3d_t filter_shape(filter_size, filter_size, depth);
+    shape3d_t channel_shape(filter_size, filter_size, 1);
+
+    // depthwise filter c is a full filter with zeros in all channels except c
+    std::vector<array3d_t<float>> weights, full_weights;
+    for (int c = 0; c < depth; c++) {
+        weights.emplace_back(channel_shape, -1.f, 1.f);
+        full_weights.emplace_back(filter_shape, 0.f);
+        for (int x = 0; x < filter_size; x++) {
+            for (int y = 0; y < filter_size; y++) { full_weights[c](x, y, c) = weights[c](x, y, 0); }
+        }
+    }
+
+    convolution_layer_2d_t<float> matrix(input_shape, filter_shape, depth, stride, padding, relu_activator);
+    matrix.load(std::move(full_weights), create_biases(depth));
+    matrix.init();
+
+    convolution_layer_depthwise_t<float> layer(input_shape, filter_size, stride, padding, relu_activator);
+    layer.load(std::move(weights), create_biases(depth));
+    layer.init();
+
+    fake_optimizer_t matrix_optimizer, layer_optimizer;
+    check_same_results(matrix, layer, input_shape, matrix_optimizer, layer_optimizer);
+    if (::testing::Test::HasFatalFailure()) { return; }
+
+    // gradients of all filters are one [filters, filter_size] block
+    ASSERT_EQ(matrix_optimizer.get_nabla_w().size(), 1);
+    ASSERT_EQ(layer_optimizer.get_nabla_w().size(), 1);
+    auto &matrix_nabla_w = matrix_optimizer.get_nabla_w()[0];
+    auto &layer_nabla_w = layer_optimizer.get_nabla_w()[0];
+
+    for (int c = 0; c < depth; c++) {
+        for (int x = 0; x < filter_size; x++) {
+            for (int y = 0; y < filter_size; y++) {
+                const float expected = matrix_nabla_w(c, (x * filter_size + y) * depth + c, 0);
+                ASSERT_NEAR(expected, layer_nabla_w(c, x * filter_size + y, 0), 1e-4f * std::max(1.f, (float)fabs(expected)));
+            }
+        }
+    }
+}
+
+TEST (ConvolutionTests, DepthwiseMatchesMatrixTest) {
+    check_depthwise_matches_matrix(yannpp::padding_type::same, 3, 1);
+    check_depthwise_matches_matrix(yannpp::padding_type::valid, 5, 1);
+    check_depthwise_matches_matrix(yannpp::padding_type::same, 3, 2);
+}
+
+TEST (ConvolutionTests, PointwiseMatchesLoopTest) {
+    using namespace yannpp;
+
+    shape3d_t input_shape(15, 13, 6);
+    shape3d_t filter_shape(1, 1, 6);
+    int filters_number = 10;
+
+    convolution_layer_loop_t<float> loop(input_shape, filter_shape, filters_number, 1, padding_type::valid, relu_activator);
+    loop.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    loop.init();
+
+    convolution_layer_pointwise_t<float> layer(input_shape, filters_number, relu_activator);
+    layer.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    layer.init();
+
+    fake_optimizer_t loop_optimizer, layer_optimizer;
+    check_same_results(loop, layer, input_shape, loop_optimizer, layer_optimizer);
+    if (::testing::Test::HasFatalFailure()) { return; }
+
+    auto &loop_nabla_w = loop_optimizer.get_nabla_w();
+    auto &layer_nabla_w = layer_optimizer.get_nabla_w();
+
+    ASSERT_EQ(loop_nabla_w.size(), layer_nabla_w.size());
+    for (size_t i = 0; i < loop_nabla_w.size(); i++) {
+        auto &lw = loop_nabla_w[i];
+        auto &w = layer_nabla_w[i];
+        ASSERT_TRUE(arrays_near(lw.raw(), w.raw(), lw.size(), 1e-5f)) << "Arrays are not equal at " << i;
+    }
+}
+
+void check_fused_pooling_matches_layers(yannpp::padding_type padding, int filter_size, int stride) {
+    using namespace yannpp;
+
+    shape3d_t input_shape(15, 13, 5);
+    shape3d_t filter_shape(filter_size, filter_size, 5);
+    int filters_number = 10;
+
+    convolution_layer_2d_t<float, relu_activation_t> conv(input_shape, filter_shape, filters_number, stride, padding);
+    conv.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    conv.init();
+    pooling_layer_t<float> pool(2, 2);
+
+    convolution_pooling_layer_t<float> fused(input_shape, filter_shape, filters_number, stride, padding);
+    fused.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    fused.init();
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    auto po = pool.feedforward(conv.feedforward(input.clone()));
+    auto fo = fused.feedforward(input.clone());
+    ASSERT_EQ(po.shape(), fo.shape());
+    ASSERT_EQ(po.shape(), fused.get_pooled_shape());
+    ASSERT_TRUE(arrays_near(po.raw(), fo.raw(), po.size(), 1e-5f));
+
+    array3d_t<float> error(po.shape(), -1.f, 1.f);
+    auto pd = conv.backpropagate(pool.backpropagate(error.clone()));
+    auto fd = fused.backpropagate(error.clone());
+    ASSERT_TRUE(arrays_near(pd.raw(), fd.raw(), pd.size(), 1e-5f));
+
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(po.shape(), -1.f, 1.f);
+    }
+    auto pbo = pool.feedforward_batch(conv.feedforward_batch(array4d_t<float>(inputs)));
+    auto fbo = fused.feedforward_batch(array4d_t<float>(inputs));
+    ASSERT_TRUE(arrays_near(pbo.raw(), fbo.raw(), pbo.size(), 1e-5f));
+
+    auto pbd = conv.backpropagate_batch(pool.backpropagate_batch(array4d_t<float>(errors)));
+    auto fbd = fused.backpropagate_batch(array4d_t<float>(errors));
+    ASSERT_TRUE(arrays_near(pbd.raw(), fbd.raw(), pbd.size(), 1e-5f));
+
+    fake_optimizer_t conv_optimizer, fused_optimizer;
+    conv.optimize(conv_optimizer);
+    fused.optimize(fused_optimizer);
+    ASSERT_EQ(conv_optimizer.get_nabla_w().size(), fused_optimizer.get_nabla_w().size());
+    for (size_t i = 0; i < conv_optimizer.get_nabla_w().size(); i++) {
+        auto &cw = conv_optimizer.get_nabla_w()[i];
+        auto &fw = fused_optimizer.get_nabla_w()[i];
+        ASSERT_TRUE(arrays_near(cw.raw(), fw.raw(), cw.size(), 1e-5f)) << "Arrays are not equal at " << i;
+    }
+    ASSERT_EQ(conv_optimizer.get_nabla_b().size(), fused_optimizer.get_nabla_b().size());
+    for (size_t i = 0; i < conv_optimizer.get_nabla_b().size(); i++) {
+        auto &cb = conv_optimizer.get_nabla_b()[i];
+        auto &fb = fused_optimizer.get_nabla_b()[i];
+        for (size_t j = 0; j < cb.size(); j++) { ASSERT_NEAR(cb.raw()[j], fb.raw()[j], 1e-3f); }
+    }
+}
+
+TEST (ConvolutionTests, FusedPoolingMatchesLayersTest) {
+    // odd convolution sizes have last row and column dropped by pooling
+    check_fused_pooling_matches_layers(yannpp::padding_type::valid, 3, 1);
+    check_fused_pooling_matches_layers(yannpp::padding_type::same, 3, 1);
+    check_fused_pooling_matches_layers(yannpp::padding_type::valid, 5, 1);
+    check_fused_pooling_matches_layers(yannpp::padding_type::valid, 3, 2);
+}
+
+TEST (ConvolutionTests, FusedPoolingInsideParallelRegionTest) {
+    using namespace yannpp;
+
+    shape3d_t input_shape(15, 13, 5);
+    shape3d_t filter_shape(3, 3, 5);
+    int filters_number = 10;
+
+    // single thread context, the layer is used from a thread with bigger number
+    execution_context_t context(1);
+    convolution_pooling_layer_t<float> fused(input_shape, filter_shape, filters_number, 1, padding_type::same);
+    fused.set_execution_context(context);
+    fused.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    fused.init();
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    auto expected = fused.feedforward(input.clone());
+    array3d_t<float> error(expected.shape(), -1.f, 1.f);
+    auto expected_delta = fused.backpropagate(error.clone());
+
+    array3d_t<float> output, delta;
+#   pragma omp parallel num_threads(4)
+{
+    if (omp_get_thread_num() == omp_get_num_threads() - 1) {
+        output = fused.feedforward(input.clone());
+        delta = fused.backpropagate(error.clone());
+    }
+}
+    ASSERT_EQ(expected.shape(), output.shape());
+    ASSERT_TRUE(arrays_near(expected.raw(), output.raw(), expected.size(), 1e-6f));
+    ASSERT_EQ(expected_delta.shape(), delta.shape());
+    ASSERT_TRUE(arrays_near(expected_delta.raw(), delta.raw(), delta.size(), 1e-6f));
+}
+
+// points tuning cache of the process to a scratch file for the duration of a test
+// and restores it even if the test fails
+class AutoTunedConvolutionTests: public ::testing::Test
+{
+protected:
+    virtual void SetUp() override {
+        std::remove(cache_path);
+        setenv("YANNPP_TUNING_CACHE", cache_path, 1);
+    }
+
+    virtual void TearDown() override {
+        unsetenv("YANNPP_TUNING_CACHE");
+        std::remove(cache_path);
+    }
+
+protected:
+    const char *cache_path = "yannpp_tuning_test.txt";
+};
+
+TEST_F (AutoTunedConvolutionTests, AutoTunedMatchesLoopTest) {
+    using namespace yannpp;
+
+    shape3d_t input_shape(15, 13, 5);
+    shape3d_t filter_shape(3, 3, 5);
+    int filters_number = 10;
+
+    convolution_layer_loop_t<float> loop(input_shape, filter_shape, filters_number, 1, padding_type::same, relu_activator);
+    loop.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    loop.init();
+
+    convolution_layer_auto_t<float> tuned(input_shape, filter_shape, filters_number, 1, padding_type::same, relu_activator);
+    tuned.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    tuned.init();
+    ASSERT_GE(tuned.threads(), 1);
+    ASSERT_EQ(loop.get_output_shape(), tuned.get_output_shape());
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    auto lo = loop.feedforward(input.clone());
+    auto to = tuned.feedforward(input.clone());
+    ASSERT_TRUE(arrays_near(lo.raw(), to.raw(), lo.size(), 1e-5f));
+
+    // result was stored and the next layer of the same shape takes it from the cache
+    std::string key, name;
+    int threads = 0;
+    {
+        std::ifstream file(cache_path);
+        ASSERT_TRUE(bool(file >> key >> name >> threads));
+        ASSERT_EQ(std::string(convolution_algorithm_name(tuned.algorithm())), name);
+        ASSERT_EQ(tuned.threads(), threads);
+    }
+    {
+        std::ofstream file(cache_path, std::ios::app);
+        file << key << " blocked 1\n";
+    }
+
+    convolution_layer_auto_t<float> cached(input_shape, filter_shape, filters_number, 1, padding_type::same, relu_activator);
+    cached.load(create_filters(filters_number, filter_shape), create_biases(filters_number));
+    cached.init();
+    ASSERT_EQ(convolution_algorithm::blocked, cached.algorithm());
+    ASSERT_EQ(1, cached.threads());
+
+    auto co = cached.feedforward(input.clone());
+    ASSERT_TRUE(arrays_near(lo.raw(), co.raw(), lo.size(), 1e-5f));
 }
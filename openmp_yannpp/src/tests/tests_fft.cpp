@@ -0,0 +1,93 @@
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <yannpp/common/fft.h>
+
+using complex_type = std::complex<double>;
+
+std::vector<complex_type> naive_dft(std::vector<complex_type> const &x, bool inverse) {
+    const size_t n = x.size();
+    const double pi = std::acos(-1.0);
+    std::vector<complex_type> result(n);
+    for (size_t k = 0; k < n; k++) {
+        complex_type sum = 0;
+        for (size_t j = 0; j < n; j++) {
+            const double angle = (inverse ? 2.0 : -2.0) * pi * (double)((j * k) % n) / (double)n;
+            sum += x[j] * complex_type(std::cos(angle), std::sin(angle));
+        }
+        result[k] = sum;
+    }
+    return result;
+}
+
+TEST (FftTests, GoodSizeTest) {
+    using namespace yannpp;
+
+    ASSERT_EQ(1, fft_good_size(0));
+    ASSERT_EQ(8, fft_good_size(8));
+    ASSERT_EQ(12, fft_good_size(11));
+    ASSERT_EQ(36, fft_good_size(35));
+    ASSERT_EQ(64, fft_good_size(61));
+}
+
+TEST (FftTests, MatchesDftTest) {
+    using namespace yannpp;
+
+    // all radixes including generic prime factors
+    for (size_t n = 1; n <= 50; n++) {
+        std::vector<complex_type> x(n), forward(n), inverse(n);
+        for (auto &v: x) { v = complex_type((rand() % 200 - 100) / 50.0, (rand() % 200 - 100) / 50.0); }
+
+        fft_plan_t<double> plan(n);
+        plan.forward(x.data(), forward.data());
+        plan.inverse(x.data(), inverse.data());
+
+        auto expected_forward = naive_dft(x, false);
+        auto expected_inverse = naive_dft(x, true);
+        for (size_t k = 0; k < n; k++) {
+            ASSERT_NEAR(expected_forward[k].real(), forward[k].real(), 1e-9) << "n = " << n << ", k = " << k;
+            ASSERT_NEAR(expected_forward[k].imag(), forward[k].imag(), 1e-9) << "n = " << n << ", k = " << k;
+            ASSERT_NEAR(expected_inverse[k].real(), inverse[k].real(), 1e-9) << "n = " << n << ", k = " << k;
+            ASSERT_NEAR(expected_inverse[k].imag(), inverse[k].imag(), 1e-9) << "n = " << n << ", k = " << k;
+        }
+    }
+}
+
+TEST (FftTests, Real2DRoundtripTest) {
+    using namespace yannpp;
+
+    // 7 x 5 plane with 3 interleaved channels, zero padded to 9 x 10
+    const size_t rows = 7, cols = 5, channels = 3;
+    std::vector<double> plane(rows * cols * channels), result(rows * cols * channels, 0.0);
+    for (auto &v: plane) { v = (rand() % 200 - 100) / 50.0; }
+
+    fft2d_real_t<double> fft(9, 10);
+    std::vector<complex_type> spectrum(fft.spectrum_size());
+    fft.forward(plane.data() + 1, rows, cols, cols * channels, channels, spectrum.data());
+
+    // spectrum has to match 2d dft of the padded plane
+    const double pi = std::acos(-1.0);
+    for (size_t k1 = 0; k1 < fft.n1(); k1++) {
+        for (size_t k2 = 0; k2 < fft.columns(); k2++) {
+            complex_type sum = 0;
+            for (size_t x = 0; x < rows; x++) {
+                for (size_t y = 0; y < cols; y++) {
+                    const double angle = -2.0 * pi * ((double)(x * k1) / fft.n1() + (double)(y * k2) / fft.n2());
+                    sum += plane[(x * cols + y) * channels + 1] * complex_type(std::cos(angle), std::sin(angle));
+                }
+            }
+            ASSERT_NEAR(sum.real(), spectrum[k1 * fft.columns() + k2].real(), 1e-9);
+            ASSERT_NEAR(sum.imag(), spectrum[k1 * fft.columns() + k2].imag(), 1e-9);
+        }
+    }
+
+    fft.inverse(spectrum.data(), rows, cols, cols * channels, channels, result.data() + 1);
+    for (size_t i = 0; i < rows * cols; i++) {
+        ASSERT_NEAR(plane[i * channels + 1], result[i * channels + 1], 1e-9);
+        ASSERT_EQ(0.0, result[i * channels]);
+    }
+}
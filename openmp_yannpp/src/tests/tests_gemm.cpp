@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array3d_math.h>
+#include <yannpp/common/gemm.h>
+
+std::vector<float> random_matrix(size_t size) {
+    std::vector<float> m(size);
+    for (auto &v: m) { v = (rand() % 200 - 100) / 50.f; }
+    return m;
+}
+
+// straightforward triple loop used as a reference
+void naive_gemm(bool trans_a, bool trans_b,
+                size_t m, size_t n, size_t k,
+                float alpha, std::vector<float> const &a, std::vector<float> const &b,
+                float beta, std::vector<float> &c) {
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            double sum = 0;
+            for (size_t p = 0; p < k; p++) {
+                float aip = trans_a ? a[p * m + i] : a[i * k + p];
+                float bpj = trans_b ? b[j * k + p] : b[p * n + j];
+                sum += aip * bpj;
+            }
+            c[i * n + j] = alpha * sum + beta * c[i * n + j];
+        }
+    }
+}
+
+void check_gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, float alpha, float beta) {
+    using namespace yannpp;
+
+    auto a = random_matrix(m * k);
+    auto b = random_matrix(k * n);
+    auto c = random_matrix(m * n);
+    auto expected = c;
+
+    naive_gemm(trans_a, trans_b, m, n, k, alpha, a, b, beta, expected);
+    gemm(trans_a ? transpose_type::yes : transpose_type::no,
+         trans_b ? transpose_type::yes : transpose_type::no,
+         m, n, k,
+         alpha,
+         a.data(), trans_a ? m : k,
+         b.data(), trans_b ? k : n,
+         beta,
+         c.data(), n);
+
+    for (size_t i = 0; i < m * n; i++) {
+        ASSERT_NEAR(expected[i], c[i], 1e-3f * (1.f + fabs(expected[i])))
+                << "Difference at " << i << " for " << m << "x" << n << "x" << k;
+    }
+}
+
+TEST (GemmTests, SmallSizesTest) {
+    check_gemm(false, false, 1, 1, 1, 1.f, 0.f);
+    check_gemm(false, false, 7, 5, 3, 1.f, 0.f);
+    check_gemm(false, false, 10, 576, 25, 1.f, 0.f);
+}
+
+TEST (GemmTests, BlockEdgesTest) {
+    // sizes are not multiples of register tiles and cache blocks
+    check_gemm(false, false, 97, 33, 257, 1.f, 0.f);
+    check_gemm(false, false, 200, 300, 600, 0.5f, 2.f);
+}
+
+TEST (GemmTests, TransposedTest) {
+    check_gemm(true, false, 45, 67, 89, 1.f, 0.f);
+    check_gemm(false, true, 45, 67, 89, 1.f, 1.f);
+    check_gemm(true, true, 130, 17, 300, -1.f, 0.5f);
+}
+
+TEST (GemmTests, GemvTest) {
+    using namespace yannpp;
+
+    const size_t m = 301, n = 517;
+    auto a = random_matrix(m * n);
+    auto x = random_matrix(n);
+    auto xt = random_matrix(m);
+
+    std::vector<float> y(m), yt(n);
+    gemv(transpose_type::no, m, n, 1.f, a.data(), n, x.data(), 0.f, y.data());
+    gemv(transpose_type::yes, m, n, 1.f, a.data(), n, xt.data(), 0.f, yt.data());
+
+    for (size_t i = 0; i < m; i++) {
+        double sum = 0;
+        for (size_t j = 0; j < n; j++) { sum += a[i * n + j] * x[j]; }
+        ASSERT_NEAR(sum, y[i], 1e-3 * (1 + fabs(sum)));
+    }
+
+    for (size_t j = 0; j < n; j++) {
+        double sum = 0;
+        for (size_t i = 0; i < m; i++) { sum += a[i * n + j] * xt[i]; }
+        ASSERT_NEAR(sum, yt[j], 1e-3 * (1 + fabs(sum)));
+    }
+
+    // partial sums of rows are scaled by alpha and added to beta * y
+    auto yt_beta = yt;
+    gemv(transpose_type::yes, m, n, 0.5f, a.data(), n, xt.data(), 2.f, yt_beta.data(), 3);
+    for (size_t j = 0; j < n; j++) {
+        ASSERT_NEAR(2.5f * yt[j], yt_beta[j], 1e-3 * (1 + fabs(yt[j])));
+    }
+}
+
+TEST (GemmTests, GerTest) {
+    using namespace yannpp;
+
+    const size_t m = 123, n = 77;
+    auto a = random_matrix(m * n);
+    auto x = random_matrix(m);
+    auto y = random_matrix(n);
+    auto expected = a;
+
+    ger(m, n, 0.5f, x.data(), y.data(), a.data(), n);
+
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            ASSERT_FLOAT_EQ(expected[i * n + j] + 0.5f * x[i] * y[j], a[i * n + j]);
+        }
+    }
+}
+
+TEST (GemmTests, AddOuterProductTest) {
+    using namespace yannpp;
+
+    array3d_t<float> a(shape_row(37), -1.f, 1.f), b(shape_row(53), -1.f, 1.f);
+    array3d_t<float> c(shape3d_t(37, 53, 1), -1.f, 1.f);
+    array3d_t<float> expected = c.clone();
+    expected.add(outer_product(a, b));
+
+    add_outer_product(c, a, b);
+
+    for (size_t i = 0; i < c.size(); i++) {
+        ASSERT_FLOAT_EQ(expected.raw()[i], c.raw()[i]);
+    }
+}
+
+TEST (GemmTests, EpilogueTest) {
+    using namespace yannpp;
+
+    // k is larger than KC so epilogue must be applied only after the last panel
+    const size_t m = 50, n = 37, k = 300;
+    auto a = random_matrix(m * k);
+    auto b = random_matrix(n * k);
+    auto bias = random_matrix(n);
+    std::vector<float> c(m * n, 0.f), expected(m * n, 0.f);
+
+    naive_gemm(false, true, m, n, k, 1.f, a, b, 0.f, expected);
+    auto epilogue = [&bias](size_t j, float v) { return std::max(0.f, v + bias[j]); };
+    gemm(transpose_type::no, transpose_type::yes,
+         m, n, k,
+         1.f,
+         a.data(), k,
+         b.data(), k,
+         0.f,
+         c.data(), n,
+         4, epilogue);
+
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            const float e = std::max(0.f, expected[i * n + j] + bias[j]);
+            ASSERT_NEAR(e, c[i * n + j], 1e-3f * (1.f + fabs(e)));
+        }
+    }
+}
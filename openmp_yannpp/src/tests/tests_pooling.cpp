@@ -0,0 +1,206 @@
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/execution_context.h>
+#include <yannpp/layers/poolinglayer.h>
+#include <yannpp/layers/poolinglayer_average.h>
+
+// straightforward max pooling used as a reference, first maximum of the window wins
+// and gradients of overlapping windows are summed
+void naive_max_pooling(yannpp::array3d_t<float> const &input, yannpp::array3d_t<float> const &error,
+                       int window, int stride,
+                       yannpp::array3d_t<float> &output, yannpp::array3d_t<float> &gradient) {
+    using namespace yannpp;
+
+    auto &shape = input.shape();
+    output = array3d_t<float>(shape3d_t((shape.x() - window) / stride + 1, (shape.y() - window) / stride + 1, shape.z()), 0.f);
+    gradient = array3d_t<float>(shape, 0.f);
+    for (int x = 0; x < output.shape().x(); x++) {
+        for (int y = 0; y < output.shape().y(); y++) {
+            for (int z = 0; z < shape.z(); z++) {
+                int mx = x * stride, my = y * stride;
+                for (int wx = 0; wx < window; wx++) {
+                    for (int wy = 0; wy < window; wy++) {
+                        if (input(x * stride + wx, y * stride + wy, z) > input(mx, my, z)) {
+                            mx = x * stride + wx;
+                            my = y * stride + wy;
+                        }
+                    }
+                }
+                output(x, y, z) = input(mx, my, z);
+                if (error.size() > 0) { gradient(mx, my, z) += error(x, y, z); }
+            }
+        }
+    }
+}
+
+bool pooling_arrays_equal(float const *a, float const *b, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (fabs(a[i] - b[i]) > 1e-6f) { return false; }
+    }
+    return true;
+}
+
+void check_max_pooling(int window, int stride, yannpp::shape3d_t const &input_shape) {
+    using namespace yannpp;
+
+    execution_context_t context(4);
+    context.set_threshold(parallel_op::pooling, 0);
+    pooling_layer_t<float> pooling(window, stride);
+    pooling.set_execution_context(context);
+    pooling.init();
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    array3d_t<float> expected_output, expected_gradient;
+    naive_max_pooling(input, array3d_t<float>(), window, stride, expected_output, expected_gradient);
+    array3d_t<float> error(expected_output.shape(), -1.f, 1.f);
+    naive_max_pooling(input, error, window, stride, expected_output, expected_gradient);
+
+    auto output = pooling.feedforward(input.clone());
+    ASSERT_EQ(output.shape(), expected_output.shape());
+    ASSERT_TRUE(pooling_arrays_equal(output.raw(), expected_output.raw(), output.size()));
+    auto gradient = pooling.backpropagate(error.clone());
+    ASSERT_EQ(gradient.shape(), input_shape);
+    ASSERT_TRUE(pooling_arrays_equal(gradient.raw(), expected_gradient.raw(), gradient.size()));
+
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(expected_output.shape(), -1.f, 1.f);
+    }
+    auto batch_output = pooling.feedforward_batch(array4d_t<float>(inputs));
+    auto batch_gradient = pooling.backpropagate_batch(array4d_t<float>(errors));
+    for (int n = 0; n < 3; n++) {
+        naive_max_pooling(inputs[n], errors[n], window, stride, expected_output, expected_gradient);
+        ASSERT_TRUE(pooling_arrays_equal(batch_output.sample(n), expected_output.raw(), expected_output.size())) << "Sample " << n;
+        ASSERT_TRUE(pooling_arrays_equal(batch_gradient.sample(n), expected_gradient.raw(), expected_gradient.size())) << "Sample " << n;
+    }
+}
+
+TEST (PoolingTests, MaxPooling2x2Test) {
+    check_max_pooling(2, 2, yannpp::shape3d_t(12, 10, 5));
+    check_max_pooling(2, 2, yannpp::shape3d_t(13, 11, 3));
+}
+
+TEST (PoolingTests, MaxPooling3x3Test) {
+    // overlapping windows
+    check_max_pooling(3, 2, yannpp::shape3d_t(13, 11, 5));
+    check_max_pooling(3, 1, yannpp::shape3d_t(9, 8, 4));
+}
+
+TEST (PoolingTests, MaxPoolingGenericWindowTest) {
+    check_max_pooling(4, 3, yannpp::shape3d_t(14, 13, 6));
+}
+
+// averages of every window and error of each output spread evenly over its window
+void naive_average_pooling(yannpp::array3d_t<float> const &input, yannpp::array3d_t<float> const &error,
+                           int window, int stride,
+                           yannpp::array3d_t<float> &output, yannpp::array3d_t<float> &gradient) {
+    using namespace yannpp;
+
+    auto &shape = input.shape();
+    output = array3d_t<float>(shape3d_t((shape.x() - window) / stride + 1, (shape.y() - window) / stride + 1, shape.z()), 0.f);
+    gradient = array3d_t<float>(shape, 0.f);
+    const float scale = 1.f / (window * window);
+    for (int x = 0; x < output.shape().x(); x++) {
+        for (int y = 0; y < output.shape().y(); y++) {
+            for (int z = 0; z < shape.z(); z++) {
+                for (int wx = 0; wx < window; wx++) {
+                    for (int wy = 0; wy < window; wy++) {
+                        output(x, y, z) += scale * input(x * stride + wx, y * stride + wy, z);
+                        if (error.size() > 0) { gradient(x * stride + wx, y * stride + wy, z) += scale * error(x, y, z); }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void check_average_pooling(int window, int stride, yannpp::shape3d_t const &input_shape) {
+    using namespace yannpp;
+
+    execution_context_t context(4);
+    context.set_threshold(parallel_op::pooling, 0);
+    average_pooling_layer_t<float> pooling(window, stride);
+    pooling.set_execution_context(context);
+    pooling.init();
+
+    array3d_t<float> input(input_shape, -1.f, 1.f);
+    array3d_t<float> expected_output, expected_gradient;
+    naive_average_pooling(input, array3d_t<float>(), window, stride, expected_output, expected_gradient);
+    array3d_t<float> error(expected_output.shape(), -1.f, 1.f);
+    naive_average_pooling(input, error, window, stride, expected_output, expected_gradient);
+
+    auto output = pooling.feedforward(input.clone());
+    ASSERT_EQ(output.shape(), expected_output.shape());
+    ASSERT_TRUE(pooling_arrays_equal(output.raw(), expected_output.raw(), output.size()));
+    auto gradient = pooling.backpropagate(error.clone());
+    ASSERT_EQ(gradient.shape(), input_shape);
+    ASSERT_TRUE(pooling_arrays_equal(gradient.raw(), expected_gradient.raw(), gradient.size()));
+
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(expected_output.shape(), -1.f, 1.f);
+    }
+    auto batch_output = pooling.feedforward_batch(array4d_t<float>(inputs));
+    auto batch_gradient = pooling.backpropagate_batch(array4d_t<float>(errors));
+    for (int n = 0; n < 3; n++) {
+        naive_average_pooling(inputs[n], errors[n], window, stride, expected_output, expected_gradient);
+        ASSERT_TRUE(pooling_arrays_equal(batch_output.sample(n), expected_output.raw(), expected_output.size())) << "Sample " << n;
+        ASSERT_TRUE(pooling_arrays_equal(batch_gradient.sample(n), expected_gradient.raw(), expected_gradient.size())) << "Sample " << n;
+    }
+}
+
+TEST (PoolingTests, AveragePoolingTest) {
+    check_average_pooling(2, 2, yannpp::shape3d_t(12, 10, 5));
+    check_average_pooling(2, 2, yannpp::shape3d_t(13, 11, 3));
+    // overlapping windows
+    check_average_pooling(3, 2, yannpp::shape3d_t(13, 11, 5));
+    check_average_pooling(5, 1, yannpp::shape3d_t(14, 12, 4));
+}
+
+TEST (PoolingTests, GlobalAveragePoolingTest) {
+    using namespace yannpp;
+
+    execution_context_t context(4);
+    context.set_threshold(parallel_op::pooling, 0);
+    global_average_pooling_layer_t<float> pooling;
+    pooling.set_execution_context(context);
+    pooling.init();
+
+    const shape3d_t input_shape(7, 6, 5);
+    std::vector<array3d_t<float>> inputs, errors;
+    for (int n = 0; n < 3; n++) {
+        inputs.emplace_back(input_shape, -1.f, 1.f);
+        errors.emplace_back(shape3d_t(1, 1, input_shape.z()), -1.f, 1.f);
+    }
+    auto batch_output = pooling.feedforward_batch(array4d_t<float>(inputs));
+    auto batch_gradient = pooling.backpropagate_batch(array4d_t<float>(errors));
+
+    const float scale = 1.f / (input_shape.x() * input_shape.y());
+    for (int n = 0; n < 3; n++) {
+        array3d_t<float> expected_output(shape3d_t(1, 1, input_shape.z()), 0.f), expected_gradient(input_shape, 0.f);
+        for (int x = 0; x < input_shape.x(); x++) {
+            for (int y = 0; y < input_shape.y(); y++) {
+                for (int z = 0; z < input_shape.z(); z++) {
+                    expected_output(0, 0, z) += scale * inputs[n](x, y, z);
+                    expected_gradient(x, y, z) = scale * errors[n](0, 0, z);
+                }
+            }
+        }
+
+        ASSERT_TRUE(pooling_arrays_equal(batch_output.sample(n), expected_output.raw(), expected_output.size())) << "Sample " << n;
+        ASSERT_TRUE(pooling_arrays_equal(batch_gradient.sample(n), expected_gradient.raw(), expected_gradient.size())) << "Sample " << n;
+
+        auto output = pooling.feedforward(inputs[n].clone());
+        ASSERT_EQ(output.shape(), expected_output.shape());
+        ASSERT_TRUE(pooling_arrays_equal(output.raw(), expected_output.raw(), output.size())) << "Sample " << n;
+        auto gradient = pooling.backpropagate(errors[n].clone());
+        ASSERT_TRUE(pooling_arrays_equal(gradient.raw(), expected_gradient.raw(), gradient.size())) << "Sample " << n;
+    }
+}
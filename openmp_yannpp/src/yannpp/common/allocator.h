@@ -0,0 +1,166 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace yannpp {
+    // cache line and AVX-512 register size
+    enum { array_alignment = 64 };
+    // size of transparent huge page on x86-64
+    enum { huge_page_size = 2 * 1024 * 1024 };
+
+    namespace detail {
+        inline void *aligned_malloc(size_t bytes, size_t alignment) {
+#if defined(_WIN32)
+            return _aligned_malloc(bytes, alignment);
+#else
+            void *p = nullptr;
+            return (posix_memalign(&p, alignment, bytes) == 0) ? p : nullptr;
+#endif
+        }
+
+        inline void aligned_free(void *p) {
+#if defined(_WIN32)
+            _aligned_free(p);
+#else
+            free(p);
+#endif
+        }
+    }
+
+    // source of raw memory for arrays storage
+    // implement it to allocate from a pool, numa node etc.
+    class memory_resource_t {
+    public:
+        virtual ~memory_resource_t() {}
+        virtual void *allocate(size_t bytes) = 0;
+        virtual void deallocate(void *p, size_t bytes) = 0;
+    };
+
+    // default resource: every block starts on the cache line boundary
+    // so vectorized kernels can use aligned loads
+    class aligned_memory_resource_t: public memory_resource_t {
+    public:
+        virtual void *allocate(size_t bytes) override {
+            void *p = detail::aligned_malloc(bytes == 0 ? size_t(array_alignment) : bytes, array_alignment);
+            if (p == nullptr) { throw std::bad_alloc(); }
+            return p;
+        }
+
+        virtual void deallocate(void *p, size_t) override {
+            detail::aligned_free(p);
+        }
+    };
+
+    // blocks of at least threshold bytes are aligned to huge page boundary
+    // and advised to be backed by transparent huge pages (linux only)
+    // smaller blocks are allocated same as with aligned_memory_resource_t
+    class huge_page_memory_resource_t: public aligned_memory_resource_t {
+    public:
+        huge_page_memory_resource_t(size_t threshold = huge_page_size):
+            threshold_(threshold)
+        { }
+
+    public:
+        virtual void *allocate(size_t bytes) override {
+            if (bytes < threshold_) {
+                return aligned_memory_resource_t::allocate(bytes);
+            }
+
+            // round up to the whole number of huge pages so the tail is covered as well
+            const size_t size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+            void *p = detail::aligned_malloc(size, huge_page_size);
+            if (p == nullptr) { throw std::bad_alloc(); }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+            madvise(p, size, MADV_HUGEPAGE);
+#endif
+            return p;
+        }
+
+    private:
+        size_t threshold_;
+    };
+
+    inline memory_resource_t *aligned_memory_resource() {
+        static aligned_memory_resource_t resource;
+        return &resource;
+    }
+
+    inline memory_resource_t *huge_page_memory_resource() {
+        static huge_page_memory_resource_t resource;
+        return &resource;
+    }
+
+    namespace detail {
+        inline memory_resource_t *&default_memory_resource() {
+            static memory_resource_t *resource = aligned_memory_resource();
+            return resource;
+        }
+    }
+
+    // resource used by arrays created after this call
+    // arrays keep the resource they were created with so it has to outlive them
+    inline memory_resource_t *get_default_memory_resource() { return detail::default_memory_resource(); }
+    inline void set_default_memory_resource(memory_resource_t *resource) {
+        detail::default_memory_resource() = (resource != nullptr) ? resource : aligned_memory_resource();
+    }
+
+    // std allocator forwarding to memory resource captured at construction
+    template<typename T>
+    class aligned_allocator_t {
+    public:
+        using value_type = T;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        template<typename U>
+        struct rebind { using other = aligned_allocator_t<U>; };
+
+    public:
+        aligned_allocator_t():
+            resource_(get_default_memory_resource())
+        { }
+
+        aligned_allocator_t(memory_resource_t *resource):
+            resource_(resource)
+        { }
+
+        template<typename U>
+        aligned_allocator_t(aligned_allocator_t<U> const &other):
+            resource_(other.resource())
+        { }
+
+    public:
+        T *allocate(size_t n) { return static_cast<T*>(resource_->allocate(n * sizeof(T))); }
+        void deallocate(T *p, size_t n) { resource_->deallocate(p, n * sizeof(T)); }
+        memory_resource_t *resource() const { return resource_; }
+
+    private:
+        memory_resource_t *resource_;
+    };
+
+    template<typename T, typename U>
+    inline bool operator==(aligned_allocator_t<T> const &a, aligned_allocator_t<U> const &b) {
+        return a.resource() == b.resource();
+    }
+
+    template<typename T, typename U>
+    inline bool operator!=(aligned_allocator_t<T> const &a, aligned_allocator_t<U> const &b) {
+        return !(a == b);
+    }
+
+    template<typename T>
+    using aligned_vector_t = std::vector<T, aligned_allocator_t<T>>;
+}
+
+#endif // ALLOCATOR_H
@@ -11,11 +11,19 @@
 #include <vector>
 #include <limits>
 
+#include <yannpp/common/allocator.h>
+#include <yannpp/common/expression.h>
 #include <yannpp/common/shape.h>
+#include <yannpp/common/view3d.h>
 
 namespace yannpp {
     template<typename T>
     class array3d_t {
+    public:
+        // storage is aligned to cache line and allocated from memory resource
+        // which was the default one at the moment of construction
+        using storage_type = aligned_vector_t<T>;
+
     public:
         class slice3d {
         public:
@@ -39,9 +47,9 @@ namespace yannpp {
         public:
             inline T &operator()(size_t x, size_t y, size_t z) { return at(x, y, z); }
             inline T &operator()(size_t x) { return at(x, 0, 0); }
-            inline T &at(int x, int y, int z) { return array_.get().v_.at(array_index(x, y, z)); }
+            inline T &at(int x, int y, int z) { return array_.get().v_[array_index(x, y, z)]; }
             inline T &at(index3d_t const &index) { return at(index.x(), index.y(), index.z()); }
-            inline T const &at(int x, int y, int z) const { return array_.get().v_.at(array_index(x, y, z)); }
+            inline T const &at(int x, int y, int z) const { return array_.get().v_[array_index(x, y, z)]; }
             inline T const &at(index3d_t const &index) const { return at(index.x(), index.y(), index.z()); }
             inline T at(index3d_iterator const &it) const {
                 return in_bounds(*it) ? at(*it) : T(0);
@@ -54,6 +62,11 @@ namespace yannpp {
             }
             shape3d_t const &shape() const { return shape_; }
 
+            // unchecked view of the slice, slice has to be within array bounds
+            view3d_t<T> view() const {
+                return array_.get().view().window(start_, shape_);
+            }
+
             index3d_t argmax() const {
                 index3d_iterator it = iterator();
                 index3d_t imax(*it);
@@ -81,6 +94,7 @@ namespace yannpp {
 
         private:
             inline size_t array_index(int x, int y, int z) const {
+                assert(in_bounds(index3d_t(x, y, z)));
                 return array_.get().shape_.index(start_.add(x, y, z));
             }
 
@@ -131,19 +145,35 @@ namespace yannpp {
         {}
 
         array3d_t(shape3d_t const &shape, std::vector<T> const &v):
+            shape_(shape),
+            v_(v.begin(), v.end())
+        {
+            assert(v_.size() == shape_.capacity());
+        }
+
+        array3d_t(shape3d_t const &shape, storage_type const &v):
             shape_(shape),
             v_(v)
         {
             assert(v_.size() == shape_.capacity());
         }
 
-        array3d_t(shape3d_t const &shape, std::vector<T> &&v):
+        array3d_t(shape3d_t const &shape, storage_type &&v):
             shape_(shape),
             v_(std::move(v))
         {
             assert(v_.size() == shape_.capacity());
         }
 
+        // evaluates element-wise expression (see expression.h)
+        template<typename E, typename = typename std::enable_if<expression_traits<E>::value>::type>
+        array3d_t(shape3d_t const &shape, E const &e):
+            shape_(shape),
+            v_(shape.capacity())
+        {
+            evaluate(e, v_.data(), v_.size());
+        }
+
         template<typename Q>
         array3d_t(const std::vector<Q> &other):
             shape_(shape_row(other.size()))
@@ -174,10 +204,10 @@ namespace yannpp {
                          iend.set(d, end));
         }
 
-        std::vector<T> extract(index3d_t const &start,
-                               index3d_t const &end) const {
+        storage_type extract(index3d_t const &start,
+                             index3d_t const &end) const {
             index3d_iterator it(start, end);
-            std::vector<T> data;
+            storage_type data;
             data.reserve(it.steps_count());
             for (; it.is_valid(); ++it) {
                 T v = 0;
@@ -205,16 +235,20 @@ namespace yannpp {
         }
 
     public:
-        inline std::vector<T> const &data() const { return v_; }
+        inline storage_type const &data() const { return v_; }
+        inline T *raw() { return v_.data(); }
+        inline T const *raw() const { return v_.data(); }
+        inline view3d_t<T> view() { return view3d_t<T>(v_.data(), shape_); }
+        inline view3d_t<T const> view() const { return view3d_t<T const>(v_.data(), shape_); }
         inline shape3d_t const &shape() const { return shape_; }
         inline size_t size() const { return v_.size(); }
-        inline T &at(int x, int y, int z) { return v_.at(shape_.index(x, y, z)); }
+        inline T &at(int x, int y, int z) { assert(in_bounds(index3d_t(x, y, z))); return v_[shape_.index(x, y, z)]; }
         inline T &at(index3d_t const &index) { return at(index.x(), index.y(), index.z()); }
         inline T &operator()(int x, int y, int z) { return at(x, y, z); }
         inline T &operator()(int x, int y) { return at(x, y, 0); }
         inline T &operator()(int x) { return at(x, 0, 0); }
         inline T const &at(index3d_t const &index) const { return at(index.x(), index.y(), index.z()); }
-        inline T const &at(int x, int y, int z) const { return v_.at(shape_.index(x, y, z)); }
+        inline T const &at(int x, int y, int z) const { assert(in_bounds(index3d_t(x, y, z))); return v_[shape_.index(x, y, z)]; }
         inline T const &operator()(int x, int y, int z) const { return at(x, y, z); }
         inline T const &operator()(int x, int y) const { return at(x, y, 0); }
         inline T const &operator()(int x) const { return at(x, 0, 0); }
@@ -228,6 +262,13 @@ namespace yannpp {
 
         array3d_t<T> &operator=(array3d_t<T> const &other) = delete;
 
+        // evaluates element-wise expression in place (e.g. w.assign(w * decay - nabla * scale))
+        template<typename E>
+        array3d_t<T> &assign(E const &e) {
+            evaluate(e, v_.data(), v_.size());
+            return *this;
+        }
+
         array3d_t<T> &mul(const T &a) {
             for (auto &v: v_) { v *= a; }
             return *this;
@@ -309,7 +350,7 @@ namespace yannpp {
 
     private:
         shape3d_t shape_;
-        std::vector<T> v_;
+        storage_type v_;
     };
 }
 
@@ -5,12 +5,12 @@
 #include <cmath>
 
 #include <yannpp/common/array3d.h>
+#include <yannpp/common/execution_context.h>
+#include <yannpp/common/gemm.h>
 #include <yannpp/common/shape.h>
 
 #include <omp.h>
 
-int num_threads = 32;
-
 namespace yannpp {
     template<typename T>
     T sigmoid(T x) {
@@ -121,7 +121,8 @@ namespace yannpp {
     // dot product of matrix (H, W, 1) and vector (W, 1, 1)
     // result is vector of size (H, 1, 1)
     template<typename T>
-    array3d_t<T> dot21(array3d_t<T> const &m, array3d_t<T> const &v) {
+    array3d_t<T> dot21(array3d_t<T> const &m, array3d_t<T> const &v,
+                       execution_context_t const &context = get_default_execution_context()) {
         assert(m.shape().dim() == 2);
         assert(v.shape().dim() == 1);
         assert(m.shape().y() == v.shape().x());
@@ -130,29 +131,20 @@ namespace yannpp {
         const size_t width = m.shape().y();
         array3d_t<T> result(shape_row(height), 0);
 
-#   pragma omp parallel num_threads(num_threads)
-{
-        size_t my_rank = omp_get_thread_num();
-        size_t thread_count = omp_get_num_threads();
-        size_t local_x = height / thread_count;
-        size_t sub = height % thread_count;
-        size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-        size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-        for (size_t i = start; i < end; i++) {
-            T sum = 0;
-            for (size_t j = 0; j < width; j++) {
-                sum += v(j) * m(i, j);
-            }
-            result(i) = sum;
-        }
-}
+        gemv(transpose_type::no, height, width,
+             T(1), m.raw(), width,
+             v.raw(),
+             T(0), result.raw(),
+             context.threads_for(parallel_op::gemm, height * width));
+
         return result;
     }
 
     // outer product of vectors (H, 1, 1) and (W, 1, 1)
     // is matrix (H, W, 1)
     template<typename T>
-    array3d_t<T> outer_product(array3d_t<T> const &a, array3d_t<T> const &b) {
+    array3d_t<T> outer_product(array3d_t<T> const &a, array3d_t<T> const &b,
+                               execution_context_t const &context = get_default_execution_context()) {
         assert(a.shape().dim() == b.shape().dim());
         assert(a.shape().dim() == 1);
 
@@ -161,28 +153,37 @@ namespace yannpp {
 
         array3d_t<T> c(shape3d_t(height, width, 1), 0);
 
-#   pragma omp parallel num_threads(num_threads)
-{
-        size_t my_rank = omp_get_thread_num();
-        size_t thread_count = omp_get_num_threads();
-        size_t local_x = height / thread_count;
-        size_t sub = height % thread_count;
-        size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-        size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-        for (size_t i = start; i < end; i++) {
-            for (size_t j = 0; j < width; j++) {
-                c(i, j) = a(i) * b(j);
-            }
-        }
-}
+        ger(height, width,
+            T(1), a.raw(), b.raw(),
+            c.raw(), width,
+            context.threads_for(parallel_op::gemm, height * width));
 
         return c;
     }
 
+    // c += a * b^T in place for vectors a (H, 1, 1), b (W, 1, 1) and matrix c (H, W, 1)
+    // same as c.add(outer_product(a, b)) without the temporary matrix
+    template<typename T>
+    void add_outer_product(array3d_t<T> &c, array3d_t<T> const &a, array3d_t<T> const &b,
+                           execution_context_t const &context = get_default_execution_context()) {
+        assert(a.shape().dim() == b.shape().dim());
+        assert(a.shape().dim() == 1);
+        assert(c.shape() == shape3d_t(a.shape().x(), b.shape().x(), 1));
+
+        const size_t height = a.shape().x();
+        const size_t width = b.shape().x();
+
+        ger(height, width,
+            T(1), a.raw(), b.raw(),
+            c.raw(), width,
+            context.threads_for(parallel_op::gemm, height * width));
+    }
+
     // dot product of matrix (H, W, 1) and vector (H, 1, 1) columnwise
     // result is vector (W, 1, 1)
     template<typename T>
-    array3d_t<T> transpose_dot21(array3d_t<T> const &m, array3d_t<T> const &v) {
+    array3d_t<T> transpose_dot21(array3d_t<T> const &m, array3d_t<T> const &v,
+                                 execution_context_t const &context = get_default_execution_context()) {
         assert(m.shape().dim() == 2);
         assert(v.shape().dim() == 1);
         assert(m.shape().x() == v.shape().x());
@@ -191,22 +192,11 @@ namespace yannpp {
         const size_t height = m.shape().x();
         array3d_t<T> output(shape_row(width), 0);
 
-#   pragma omp parallel num_threads(num_threads)
-{
-        size_t my_rank = omp_get_thread_num();
-        size_t thread_count = omp_get_num_threads();
-        size_t local_x = width / thread_count;
-        size_t sub = width % thread_count;
-        size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-        size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-        for (size_t j = start; j < end; j++) {
-            T sum = 0;
-            for (size_t i = 0; i < height; i++) {
-                sum += m(i, j) * v(i);
-            }
-            output(j) = sum;
-        }
-}
+        gemv(transpose_type::yes, height, width,
+             T(1), m.raw(), width,
+             v.raw(),
+             T(0), output.raw(),
+             context.threads_for(parallel_op::gemm, height * width));
 
         return output;
     }
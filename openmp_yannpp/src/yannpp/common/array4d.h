@@ -0,0 +1,180 @@
+#ifndef ARRAY4D_H
+#define ARRAY4D_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/common/view3d.h>
+
+namespace yannpp {
+    // minibatch of N samples of the same shape (N x X x Y x Z)
+    // samples are stored one after another in contiguous memory
+    // so the whole batch can be used as (N, X*Y*Z) row-major matrix
+    template<typename T>
+    class array4d_t {
+    public:
+        using storage_type = typename array3d_t<T>::storage_type;
+
+    public:
+        array4d_t():
+            batch_size_(0),
+            shape_(0, 0, 0)
+        {}
+
+        array4d_t(size_t batch_size, shape3d_t const &shape, T a):
+            batch_size_(batch_size),
+            shape_(shape),
+            v_(batch_size * shape.capacity(), a)
+        {}
+
+        // packs samples of the same shape into one batch
+        array4d_t(std::vector<array3d_t<T>> const &samples):
+            batch_size_(samples.size()),
+            shape_(samples.empty() ? shape3d_t(0, 0, 0) : samples[0].shape())
+        {
+            v_.reserve(batch_size_ * shape_.capacity());
+            for (auto &s: samples) {
+                assert(s.shape() == shape_);
+                v_.insert(v_.end(), s.data().begin(), s.data().end());
+            }
+        }
+
+        array4d_t(array4d_t<T> const &other):
+            batch_size_(other.batch_size_),
+            shape_(other.shape_),
+            v_(other.v_)
+        {}
+
+        array4d_t(array4d_t<T> &&other):
+            batch_size_(other.batch_size_),
+            shape_(other.shape_),
+            v_(std::move(other.v_))
+        {}
+
+    public:
+        inline size_t batch_size() const { return batch_size_; }
+        // shape of the single sample
+        inline shape3d_t const &shape() const { return shape_; }
+        inline size_t size() const { return v_.size(); }
+        inline storage_type const &data() const { return v_; }
+        inline T *raw() { return v_.data(); }
+        inline T const *raw() const { return v_.data(); }
+        inline T *sample(size_t n) { return v_.data() + n * shape_.capacity(); }
+        inline T const *sample(size_t n) const { return v_.data() + n * shape_.capacity(); }
+        inline view3d_t<T> view(size_t n) { assert(n < batch_size_); return view3d_t<T>(sample(n), shape_); }
+        inline view3d_t<T const> view(size_t n) const { assert(n < batch_size_); return view3d_t<T const>(sample(n), shape_); }
+        inline T &at(size_t n, int x, int y, int z) { return view(n)(x, y, z); }
+        inline T const &at(size_t n, int x, int y, int z) const { return view(n)(x, y, z); }
+        inline T &operator()(size_t n, int x, int y, int z) { return at(n, x, y, z); }
+        inline T &operator()(size_t n, int x) { return at(n, x, 0, 0); }
+        inline T const &operator()(size_t n, int x, int y, int z) const { return at(n, x, y, z); }
+        inline T const &operator()(size_t n, int x) const { return at(n, x, 0, 0); }
+
+    public:
+        // copy of n-th sample
+        array3d_t<T> get(size_t n) const {
+            assert(n < batch_size_);
+            T const *begin = sample(n);
+            return array3d_t<T>(shape_, storage_type(begin, begin + shape_.capacity()));
+        }
+
+        void set(size_t n, array3d_t<T> const &a) {
+            assert(n < batch_size_);
+            assert(a.shape() == shape_);
+            std::copy(a.data().begin(), a.data().end(), sample(n));
+        }
+
+        // copies of all samples
+        std::vector<array3d_t<T>> samples() const {
+            std::vector<array3d_t<T>> result;
+            result.reserve(batch_size_);
+            for (size_t n = 0; n < batch_size_; n++) {
+                result.emplace_back(get(n));
+            }
+            return result;
+        }
+
+        array4d_t<T> clone() const {
+            return array4d_t(*this);
+        }
+
+    public:
+        array4d_t<T> &operator=(array4d_t<T> &&other) {
+            batch_size_ = other.batch_size_;
+            shape_ = other.shape_;
+            v_ = std::move(other.v_);
+            return *this;
+        }
+
+        array4d_t<T> &operator=(array4d_t<T> const &other) = delete;
+
+        // evaluates element-wise expression in place
+        template<typename E>
+        array4d_t<T> &assign(E const &e) {
+            evaluate(e, v_.data(), v_.size());
+            return *this;
+        }
+
+        array4d_t<T> &mul(const T &a) {
+            for (auto &v: v_) { v *= a; }
+            return *this;
+        }
+
+        array4d_t<T> &element_mul(array4d_t<T> const &other) {
+            assert(other.shape() == shape_);
+            assert(v_.size() == other.v_.size());
+
+            const size_t size = v_.size();
+            for (size_t i = 0; i < size; i++) {
+                v_[i] *= other.v_[i];
+            }
+
+            return *this;
+        }
+
+        array4d_t<T> &add(array4d_t<T> const &other) {
+            assert(other.shape() == shape_);
+            assert(v_.size() == other.v_.size());
+
+            const size_t size = v_.size();
+            for (size_t i = 0; i < size; i++) {
+                v_[i] += other.v_[i];
+            }
+
+            return *this;
+        }
+
+        array4d_t<T> &subtract(array4d_t<T> const &other) {
+            assert(other.shape() == shape_);
+            assert(v_.size() == other.v_.size());
+
+            const size_t size = v_.size();
+            for (size_t i = 0; i < size; i++) {
+                v_[i] -= other.v_[i];
+            }
+
+            return *this;
+        }
+
+        void reset(const T &a) {
+            std::fill(v_.begin(), v_.end(), a);
+        }
+
+        // changes shape of each sample, batch size stays the same
+        array4d_t<T> &reshape(shape3d_t const &shape) {
+            assert(shape_.capacity() == shape.capacity());
+            shape_ = shape;
+            return *this;
+        }
+
+    private:
+        size_t batch_size_;
+        shape3d_t shape_;
+        storage_type v_;
+    };
+}
+
+#endif // ARRAY4D_H
@@ -0,0 +1,132 @@
+#ifndef EXECUTION_CONTEXT_H
+#define EXECUTION_CONTEXT_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include <omp.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+namespace yannpp {
+    // kinds of parallel operations with separate thresholds
+    // work is measured as: elementwise - number of elements,
+    // gemm and convolution - number of multiply-adds, pooling - number of inputs
+    enum struct parallel_op {
+        elementwise,
+        gemm,
+        convolution,
+        pooling
+    };
+
+    enum { parallel_ops_count = 4 };
+
+    // pinning of the worker threads to cpus
+    enum struct affinity_type {
+        none,    // left to the OS (or OMP_PROC_BIND / OMP_PLACES)
+        compact, // thread i runs on cpu i
+        scatter  // threads are spread evenly over all cpus
+    };
+
+    // how many threads parallel regions use and when it's worth to fork them at all
+    // network2_t owns one and shares it with its layers,
+    // everything else uses get_default_execution_context()
+    class execution_context_t {
+    public:
+        // threads < 1 means omp_get_max_threads() (i.e. OMP_NUM_THREADS or number of cpus)
+        execution_context_t(int threads = 0, affinity_type affinity = affinity_type::none):
+            threads_(threads > 0 ? threads : omp_get_max_threads()),
+            affinity_(affinity)
+        {
+            thresholds_[(int)parallel_op::elementwise] = 64 * 1024;
+            thresholds_[(int)parallel_op::gemm] = 32 * 1024;
+            thresholds_[(int)parallel_op::convolution] = 16 * 1024;
+            thresholds_[(int)parallel_op::pooling] = 16 * 1024;
+        }
+
+        // defaults overridden with YANNPP_NUM_THREADS, YANNPP_AFFINITY (none, compact, scatter)
+        // and YANNPP_{ELEMENTWISE,GEMM,CONVOLUTION,POOLING}_THRESHOLD variables
+        static execution_context_t from_environment() {
+            execution_context_t context;
+
+            const char *threads = std::getenv("YANNPP_NUM_THREADS");
+            if (threads != nullptr && std::atoi(threads) > 0) { context.set_threads(std::atoi(threads)); }
+
+            const char *affinity = std::getenv("YANNPP_AFFINITY");
+            if (affinity != nullptr) {
+                if (std::strcmp(affinity, "compact") == 0) { context.set_affinity(affinity_type::compact); }
+                else if (std::strcmp(affinity, "scatter") == 0) { context.set_affinity(affinity_type::scatter); }
+            }
+
+            const char *names[parallel_ops_count] = {
+                "YANNPP_ELEMENTWISE_THRESHOLD",
+                "YANNPP_GEMM_THRESHOLD",
+                "YANNPP_CONVOLUTION_THRESHOLD",
+                "YANNPP_POOLING_THRESHOLD"
+            };
+            for (int i = 0; i < parallel_ops_count; i++) {
+                const char *value = std::getenv(names[i]);
+                if (value != nullptr) { context.set_threshold((parallel_op)i, (size_t)std::strtoull(value, nullptr, 10)); }
+            }
+
+            return context;
+        }
+
+    public:
+        inline int threads() const { return threads_; }
+        inline affinity_type affinity() const { return affinity_; }
+        inline size_t threshold(parallel_op op) const { return thresholds_[(int)op]; }
+
+        void set_threads(int threads) { threads_ = (threads > 0) ? threads : omp_get_max_threads(); }
+        void set_affinity(affinity_type affinity) { affinity_ = affinity; }
+        void set_threshold(parallel_op op, size_t threshold) { thresholds_[(int)op] = threshold; }
+
+        // number of threads for the operation with given amount of work
+        inline int threads_for(parallel_op op, size_t work) const {
+            return (work < thresholds_[(int)op]) ? 1 : threads_;
+        }
+
+        // pins threads of the OpenMP pool according to affinity (linux only)
+        // has effect as long as the runtime reuses same threads for regions of threads() size
+        void bind_threads() const {
+#if defined(__linux__) && defined(CPU_SET)
+            if (affinity_ == affinity_type::none) { return; }
+            const int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (cpus < 1) { return; }
+            const int step = (affinity_ == affinity_type::scatter && threads_ < cpus) ? (cpus / threads_) : 1;
+
+#   pragma omp parallel num_threads(threads_)
+{
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((omp_get_thread_num() * step) % cpus, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+}
+#endif
+        }
+
+    private:
+        int threads_;
+        affinity_type affinity_;
+        size_t thresholds_[parallel_ops_count];
+    };
+
+    namespace detail {
+        inline execution_context_t &default_execution_context() {
+            static execution_context_t context = execution_context_t::from_environment();
+            return context;
+        }
+    }
+
+    // context of layers outside of network2_t and of free functions (e.g. expressions)
+    inline execution_context_t const &get_default_execution_context() { return detail::default_execution_context(); }
+    inline void set_default_execution_context(execution_context_t const &context) {
+        detail::default_execution_context() = context;
+    }
+}
+
+#endif // EXECUTION_CONTEXT_H
@@ -0,0 +1,206 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+#include <yannpp/common/execution_context.h>
+
+namespace yannpp {
+    template<typename T>
+    class array3d_t;
+
+    template<typename T>
+    class array4d_t;
+
+    // lazy element-wise expressions over arrays
+    // e.g. w.assign(decay * w - scale * nabla_w) is computed in one loop
+    // without temporaries, nothing is evaluated until assign()
+    // expressions keep pointers to the arrays so they must not outlive them
+
+    // base of all expression nodes
+    struct expression_node_t {};
+
+    // leaf: contiguous data of an array
+    template<typename T>
+    class array_ref_t: public expression_node_t {
+    public:
+        using value_type = T;
+
+        array_ref_t(T const *data, size_t size):
+            data_(data),
+            size_(size)
+        { }
+
+    public:
+        inline T operator[](size_t i) const { return data_[i]; }
+        inline size_t size() const { return size_; }
+
+    private:
+        T const *data_;
+        size_t size_;
+    };
+
+    // leaf: same value for every element (size 0 matches any size)
+    template<typename T>
+    class scalar_t: public expression_node_t {
+    public:
+        using value_type = T;
+
+        scalar_t(T v):
+            v_(v)
+        { }
+
+    public:
+        inline T operator[](size_t) const { return v_; }
+        inline size_t size() const { return 0; }
+
+    private:
+        T v_;
+    };
+
+    template<typename L, typename R, typename Op>
+    class binary_t: public expression_node_t {
+    public:
+        using value_type = typename L::value_type;
+
+        binary_t(L const &l, R const &r):
+            l_(l),
+            r_(r)
+        {
+            assert(l_.size() == 0 || r_.size() == 0 || l_.size() == r_.size());
+        }
+
+    public:
+        inline value_type operator[](size_t i) const { return Op::apply(l_[i], r_[i]); }
+        inline size_t size() const { return l_.size() != 0 ? l_.size() : r_.size(); }
+
+    private:
+        L l_;
+        R r_;
+    };
+
+    // f(x) applied to each element, f is a function object
+    template<typename E, typename F>
+    class unary_t: public expression_node_t {
+    public:
+        using value_type = typename E::value_type;
+
+        unary_t(E const &e, F const &f):
+            e_(e),
+            f_(f)
+        { }
+
+    public:
+        inline value_type operator[](size_t i) const { return f_(e_[i]); }
+        inline size_t size() const { return e_.size(); }
+
+    private:
+        E e_;
+        F f_;
+    };
+
+    struct add_op { template<typename T> static inline T apply(T a, T b) { return a + b; } };
+    struct subtract_op { template<typename T> static inline T apply(T a, T b) { return a - b; } };
+    struct mul_op { template<typename T> static inline T apply(T a, T b) { return a * b; } };
+    struct div_op { template<typename T> static inline T apply(T a, T b) { return a / b; } };
+
+    // maps operands (arrays or expression nodes) to expression nodes
+    template<typename X, typename = void>
+    struct expression_traits {
+        enum { value = 0 };
+    };
+
+    template<typename X>
+    struct expression_traits<X, typename std::enable_if<std::is_base_of<expression_node_t, X>::value>::type> {
+        enum { value = 1 };
+        using value_type = typename X::value_type;
+        using node_type = X;
+        static node_type const &node(X const &x) { return x; }
+    };
+
+    template<typename T>
+    struct expression_traits<array3d_t<T>> {
+        enum { value = 1 };
+        using value_type = T;
+        using node_type = array_ref_t<T>;
+        static node_type node(array3d_t<T> const &a) { return node_type(a.raw(), a.size()); }
+    };
+
+    template<typename T>
+    struct expression_traits<array4d_t<T>> {
+        enum { value = 1 };
+        using value_type = T;
+        using node_type = array_ref_t<T>;
+        static node_type node(array4d_t<T> const &a) { return node_type(a.raw(), a.size()); }
+    };
+
+    template<typename L, typename R, typename Op>
+    struct binary_expression {
+        using type = binary_t<typename expression_traits<L>::node_type,
+                              typename expression_traits<R>::node_type,
+                              Op>;
+        static type make(L const &l, R const &r) {
+            return type(expression_traits<L>::node(l), expression_traits<R>::node(r));
+        }
+    };
+
+    template<typename L, typename Op>
+    struct scalar_expression {
+        using value_type = typename expression_traits<L>::value_type;
+        using right_type = binary_t<typename expression_traits<L>::node_type, scalar_t<value_type>, Op>;
+        using left_type = binary_t<scalar_t<value_type>, typename expression_traits<L>::node_type, Op>;
+    };
+
+#define YANNPP_EXPRESSION_OPERATOR(op, op_type) \
+    template<typename L, typename R> \
+    inline typename std::enable_if<expression_traits<L>::value && expression_traits<R>::value, \
+                                   binary_expression<L, R, op_type>>::type::type \
+    operator op(L const &l, R const &r) { \
+        return binary_expression<L, R, op_type>::make(l, r); \
+    } \
+    \
+    template<typename L> \
+    inline typename std::enable_if<expression_traits<L>::value, scalar_expression<L, op_type>>::type::right_type \
+    operator op(L const &l, typename expression_traits<L>::value_type r) { \
+        using value_type = typename expression_traits<L>::value_type; \
+        return typename scalar_expression<L, op_type>::right_type(expression_traits<L>::node(l), scalar_t<value_type>(r)); \
+    } \
+    \
+    template<typename R> \
+    inline typename std::enable_if<expression_traits<R>::value, scalar_expression<R, op_type>>::type::left_type \
+    operator op(typename expression_traits<R>::value_type l, R const &r) { \
+        using value_type = typename expression_traits<R>::value_type; \
+        return typename scalar_expression<R, op_type>::left_type(scalar_t<value_type>(l), expression_traits<R>::node(r)); \
+    }
+
+    YANNPP_EXPRESSION_OPERATOR(+, add_op)
+    YANNPP_EXPRESSION_OPERATOR(-, subtract_op)
+    YANNPP_EXPRESSION_OPERATOR(*, mul_op)
+    YANNPP_EXPRESSION_OPERATOR(/, div_op)
+
+#undef YANNPP_EXPRESSION_OPERATOR
+
+    // element-wise f(x) of an array or expression
+    template<typename E, typename F>
+    inline unary_t<typename expression_traits<E>::node_type, F> elementwise(E const &e, F const &f) {
+        return unary_t<typename expression_traits<E>::node_type, F>(expression_traits<E>::node(e), f);
+    }
+
+    // writes all elements of the expression to out in one pass
+    // out may be one of the arrays used in the expression
+    template<typename E, typename T>
+    void evaluate(E const &e, T *out, size_t size,
+                  execution_context_t const &context = get_default_execution_context()) {
+        auto const &node = expression_traits<E>::node(e);
+        assert(node.size() == 0 || node.size() == size);
+        const int threads = context.threads_for(parallel_op::elementwise, size);
+#   pragma omp parallel for simd num_threads(threads) if(threads > 1) schedule(static)
+        for (long i = 0; i < (long)size; i++) {
+            out[i] = node[i];
+        }
+    }
+}
+
+#endif // EXPRESSION_H
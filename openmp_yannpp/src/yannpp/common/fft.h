@@ -0,0 +1,244 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace yannpp {
+    // smallest size >= n that has only 2, 3 and 5 as factors
+    inline size_t fft_good_size(size_t n) {
+        if (n <= 1) { return 1; }
+        for (size_t size = n; ; size++) {
+            size_t m = size;
+            while (m % 2 == 0) { m /= 2; }
+            while (m % 3 == 0) { m /= 3; }
+            while (m % 5 == 0) { m /= 5; }
+            if (m == 1) { return size; }
+        }
+    }
+
+    // complex product without the inf/nan checks of std::complex operator*
+    // (which are a library call unless -ffast-math is used)
+    template<typename T>
+    inline std::complex<T> complex_mul(std::complex<T> const &a, std::complex<T> const &b) {
+        return std::complex<T>(a.real() * b.real() - a.imag() * b.imag(),
+                               a.real() * b.imag() + a.imag() * b.real());
+    }
+
+    // complex mixed-radix fft of fixed size n (recursive decimation in time)
+    // factors 2 and 4 have own butterflies, others (3 and 5 for fft_good_size()) use generic one
+    // forward is X(k) = Sum x(j) exp(-2 pi i jk / n), inverse has +i and is not scaled
+    template<typename T>
+    class fft_plan_t {
+    public:
+        using complex_type = std::complex<T>;
+
+        explicit fft_plan_t(size_t n = 1): n_(std::max<size_t>(1, n)) {
+            size_t m = n_;
+            while (m % 4 == 0) { factors_.push_back(4); m /= 4; }
+            while (m % 2 == 0) { factors_.push_back(2); m /= 2; }
+            for (size_t p = 3; p * p <= m; p += 2) {
+                while (m % p == 0) { factors_.push_back(p); m /= p; }
+            }
+            if (m > 1) { factors_.push_back(m); }
+
+            twiddles_.resize(n_);
+            const double pi = std::acos(-1.0);
+            for (size_t k = 0; k < n_; k++) {
+                const double angle = -2.0 * pi * (double)k / (double)n_;
+                twiddles_[k] = complex_type((T)std::cos(angle), (T)std::sin(angle));
+            }
+        }
+
+    public:
+        inline size_t size() const { return n_; }
+
+        // in and out must not overlap
+        void forward(complex_type const *in, complex_type *out) const { transform(in, out, n_, 1, 0, false); }
+        void inverse(complex_type const *in, complex_type *out) const { transform(in, out, n_, 1, 0, true); }
+
+    private:
+        // exp(-+2 pi i k / n_)
+        inline complex_type twiddle(size_t k, bool inverse) const {
+            complex_type w = twiddles_[k % n_];
+            return inverse ? std::conj(w) : w;
+        }
+
+        void transform(complex_type const *in, complex_type *out,
+                       size_t n, size_t stride, size_t factor, bool inverse) const {
+            if (n == 1) { out[0] = in[0]; return; }
+
+            const size_t p = factors_[factor];
+            const size_t m = n / p;
+            // dfts of p decimated sequences are written one after another
+            for (size_t q = 0; q < p; q++) {
+                transform(in + q * stride, out + q * m, m, stride * p, factor + 1, inverse);
+            }
+
+            // twiddles of size n are every stride-th twiddle of size n_
+            switch (p) {
+            case 2:
+                for (size_t k = 0; k < m; k++) {
+                    const complex_type a = out[k];
+                    const complex_type b = complex_mul(out[k + m], twiddle(k * stride, inverse));
+                    out[k] = a + b;
+                    out[k + m] = a - b;
+                }
+                break;
+
+            case 4: {
+                // multiplication by -i (or +i for inverse)
+                const T s = inverse ? T(-1) : T(1);
+                for (size_t k = 0; k < m; k++) {
+                    const complex_type a0 = out[k];
+                    const complex_type a1 = complex_mul(out[k + m], twiddle(k * stride, inverse));
+                    const complex_type a2 = complex_mul(out[k + 2 * m], twiddle(2 * k * stride, inverse));
+                    const complex_type a3 = complex_mul(out[k + 3 * m], twiddle(3 * k * stride, inverse));
+                    const complex_type t0 = a0 + a2, t1 = a0 - a2;
+                    const complex_type t2 = a1 + a3, t3 = a1 - a3;
+                    const complex_type t3i(s * t3.imag(), -s * t3.real());
+                    out[k] = t0 + t2;
+                    out[k + m] = t1 + t3i;
+                    out[k + 2 * m] = t0 - t2;
+                    out[k + 3 * m] = t1 - t3i;
+                }
+                break;
+            }
+
+            default: {
+                // generic radix: X(k + s m) = Sum_q W_n^(qk) Y_q(k) W_p^(qs)
+                // radixes 3 and 5 (sizes from fft_good_size()) don't allocate
+                complex_type small[8];
+                std::vector<complex_type> large(p > 8 ? p : 0);
+                complex_type *t = (p > 8) ? large.data() : small;
+                const size_t root = n_ / p;
+                for (size_t k = 0; k < m; k++) {
+                    for (size_t q = 0; q < p; q++) {
+                        t[q] = complex_mul(out[k + q * m], twiddle(q * k * stride, inverse));
+                    }
+                    for (size_t s = 0; s < p; s++) {
+                        complex_type sum = t[0];
+                        for (size_t q = 1; q < p; q++) { sum += complex_mul(t[q], twiddle(((q * s) % p) * root, inverse)); }
+                        out[k + s * m] = sum;
+                    }
+                }
+                break;
+            }
+            }
+        }
+
+    private:
+        size_t n_;
+        std::vector<size_t> factors_;
+        std::vector<complex_type> twiddles_;
+    };
+
+    // 2d fft of real n1 x n2 planes, spectrum is n1 x (n2 / 2 + 1) complex matrix
+    // (the rest of columns follows from hermitian symmetry)
+    // planes are read and written with strides so channels of array3d_t can be used directly
+    template<typename T>
+    class fft2d_real_t {
+    public:
+        using complex_type = std::complex<T>;
+
+        fft2d_real_t(size_t n1 = 1, size_t n2 = 1):
+            n1_(std::max<size_t>(1, n1)), n2_(std::max<size_t>(1, n2)),
+            rows_plan_(n2_), columns_plan_(n1_)
+        { }
+
+    public:
+        inline size_t n1() const { return n1_; }
+        inline size_t n2() const { return n2_; }
+        inline size_t columns() const { return n2_ / 2 + 1; }
+        inline size_t spectrum_size() const { return n1_ * columns(); }
+        // temporary memory of forward() and inverse()
+        inline size_t workspace_size() const { return spectrum_size() + 2 * (n1_ + n2_); }
+
+        // spectrum of rows x cols real plane zero padded to n1 x n2
+        // in(x, y) is in[x * row_stride + y * col_stride]
+        // work is workspace_size() elements, allocated by the call if it's null
+        void forward(T const *in, size_t rows, size_t cols, size_t row_stride, size_t col_stride,
+                     complex_type *spectrum, complex_type *work = nullptr) const {
+            assert(rows <= n1_ && cols <= n2_);
+            const size_t h = columns();
+            std::vector<complex_type> local(work ? 0 : workspace_size());
+            complex_type *z = work ? work : local.data();
+            complex_type *zf = z + n2_, *c = zf + n2_, *cf = c + n1_;
+            std::fill(spectrum, spectrum + spectrum_size(), complex_type(0));
+
+            // two real rows a and b are transformed at once as a + ib
+            for (size_t r = 0; r < rows; r += 2) {
+                const bool pair = (r + 1 < rows);
+                T const *a = in + r * row_stride;
+                T const *b = a + row_stride;
+                for (size_t y = 0; y < n2_; y++) {
+                    z[y] = (y < cols) ? complex_type(a[y * col_stride], pair ? b[y * col_stride] : T(0)) : complex_type(0);
+                }
+                rows_plan_.forward(z, zf);
+
+                complex_type *sa = spectrum + r * h;
+                complex_type *sb = sa + h;
+                for (size_t k = 0; k < h; k++) {
+                    const complex_type zk = zf[k], zn = std::conj(zf[(n2_ - k) % n2_]);
+                    sa[k] = (zk + zn) * T(0.5);
+                    // (zk - zn) / 2i
+                    if (pair) { sb[k] = complex_type((zk - zn).imag(), -(zk - zn).real()) * T(0.5); }
+                }
+            }
+
+            for (size_t k = 0; k < h; k++) {
+                for (size_t x = 0; x < n1_; x++) { c[x] = spectrum[x * h + k]; }
+                columns_plan_.forward(c, cf);
+                for (size_t x = 0; x < n1_; x++) { spectrum[x * h + k] = cf[x]; }
+            }
+        }
+
+        // rows x cols top-left part of the inverse transform (scaled by 1 / (n1 n2))
+        void inverse(complex_type const *spectrum, size_t rows, size_t cols, size_t row_stride, size_t col_stride,
+                     T *out, complex_type *work = nullptr) const {
+            assert(rows <= n1_ && cols <= n2_);
+            const size_t h = columns();
+            std::vector<complex_type> local(work ? 0 : workspace_size());
+            complex_type *s = work ? work : local.data();
+            complex_type *c = s + n1_ * h, *cf = c + n1_, *z = cf + n1_, *zf = z + n2_;
+
+            for (size_t k = 0; k < h; k++) {
+                for (size_t x = 0; x < n1_; x++) { c[x] = spectrum[x * h + k]; }
+                columns_plan_.inverse(c, cf);
+                for (size_t x = 0; x < n1_; x++) { s[x * h + k] = cf[x]; }
+            }
+
+            const T scale = T(1) / T(n1_ * n2_);
+            for (size_t r = 0; r < rows; r += 2) {
+                const bool pair = (r + 1 < rows);
+                complex_type const *sa = &s[r * h];
+                complex_type const *sb = pair ? sa + h : nullptr;
+                // full spectrum of a + ib from halves of both hermitian spectra
+                for (size_t k = 0; k < n2_; k++) {
+                    const bool lower = (k < h);
+                    const complex_type a = lower ? sa[k] : std::conj(sa[n2_ - k]);
+                    const complex_type b = pair ? (lower ? sb[k] : std::conj(sb[n2_ - k])) : complex_type(0);
+                    z[k] = complex_type(a.real() - b.imag(), a.imag() + b.real());
+                }
+                rows_plan_.inverse(z, zf);
+
+                T *oa = out + r * row_stride;
+                T *ob = oa + row_stride;
+                for (size_t y = 0; y < cols; y++) {
+                    oa[y * col_stride] = zf[y].real() * scale;
+                    if (pair) { ob[y * col_stride] = zf[y].imag() * scale; }
+                }
+            }
+        }
+
+    private:
+        size_t n1_, n2_;
+        fft_plan_t<T> rows_plan_, columns_plan_;
+    };
+}
+
+#endif // FFT_H
@@ -0,0 +1,324 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include <omp.h>
+
+#include <yannpp/common/allocator.h>
+
+namespace yannpp {
+    // all matrices are row-major (same as array3d_t of shape (H, W, 1)),
+    // ld* is the distance between the beginnings of two consecutive rows
+    enum struct transpose_type {
+        no,
+        yes
+    };
+
+    // blocking parameters of the gemm engine:
+    // MR x NR is the register tile computed by the micro-kernel,
+    // KC x NR panel of B is sized to stay in L1, MC x KC block of A - in L2
+    // and KC x NC panel of B - in L3
+    template<typename T>
+    struct gemm_blocking_t {
+        enum { MR = 6, NR = 8, MC = 96, KC = 256, NC = 2048 };
+    };
+
+    template<>
+    struct gemm_blocking_t<float> {
+        enum { MR = 6, NR = 16, MC = 96, KC = 256, NC = 4096 };
+    };
+
+    // no-op function applied to each element of C after it's computed:
+    // c(i, j) = epilogue(j, c(i, j)), e.g. to add bias of column j and activate
+    struct identity_epilogue_t {
+        template<typename T> inline T operator()(size_t, T v) const { return v; }
+    };
+
+    namespace detail {
+        // callers decide the number of threads (see execution_context_t::threads_for)
+        inline int gemm_threads(int threads) {
+            return (threads < 1) ? 1 : threads;
+        }
+
+        // copies mc x kc block of op(A) into MR-wide row panels
+        // each panel is stored column by column, so micro-kernel reads it sequentially
+        // rows past mc are zero-padded to keep the micro-kernel branch-free
+        template<typename T>
+        void pack_a(size_t mc, size_t kc,
+                    T const *a, size_t row_stride, size_t col_stride,
+                    T *buffer) {
+            const size_t MR = gemm_blocking_t<T>::MR;
+            for (size_t ir = 0; ir < mc; ir += MR) {
+                const size_t mr = std::min(MR, mc - ir);
+                for (size_t p = 0; p < kc; p++) {
+                    T const *src = a + ir * row_stride + p * col_stride;
+                    size_t i = 0;
+                    for (; i < mr; i++) { buffer[i] = src[i * row_stride]; }
+                    for (; i < MR; i++) { buffer[i] = T(0); }
+                    buffer += MR;
+                }
+            }
+        }
+
+        // copies single kc x NR panel of op(B) row by row
+        // columns past nr are zero-padded
+        template<typename T>
+        void pack_b_panel(size_t kc, size_t nr,
+                          T const *b, size_t row_stride, size_t col_stride,
+                          T *buffer) {
+            const size_t NR = gemm_blocking_t<T>::NR;
+            for (size_t p = 0; p < kc; p++) {
+                T const *src = b + p * row_stride;
+                size_t j = 0;
+                if (col_stride == 1) {
+                    for (; j < nr; j++) { buffer[j] = src[j]; }
+                } else {
+                    for (; j < nr; j++) { buffer[j] = src[j * col_stride]; }
+                }
+                for (; j < NR; j++) { buffer[j] = T(0); }
+                buffer += NR;
+            }
+        }
+
+        // computes MR x NR tile C = alpha * A * B + beta * C
+        // where A and B are packed panels, accumulators are kept in registers
+        // only mr x nr top-left part of the tile is written back
+        // epilogue is applied to the tile (its first column is col) only with the last panel of k
+        template<typename T, typename Epilogue>
+        inline void gemm_micro_kernel(size_t kc,
+                                      T const *a, T const *b,
+                                      T *c, size_t ldc,
+                                      size_t mr, size_t nr,
+                                      T alpha, T beta,
+                                      Epilogue const &epilogue, size_t col, bool last) {
+            enum { MR = gemm_blocking_t<T>::MR, NR = gemm_blocking_t<T>::NR };
+            T acc[MR][NR];
+            for (int i = 0; i < MR; i++) {
+                for (int j = 0; j < NR; j++) { acc[i][j] = T(0); }
+            }
+
+            // packed panels of B start on cache line boundary and NR row is one cache line
+            static_assert((NR * sizeof(T)) % array_alignment == 0, "row of B panel has to keep alignment");
+            for (size_t p = 0; p < kc; p++) {
+                for (int i = 0; i < MR; i++) {
+                    const T ai = a[i];
+#   pragma omp simd aligned(b: 64)
+                    for (int j = 0; j < NR; j++) {
+                        acc[i][j] += ai * b[j];
+                    }
+                }
+                a += MR;
+                b += NR;
+            }
+
+            for (size_t i = 0; i < mr; i++) {
+                T *ci = c + i * ldc;
+                if (beta == T(0)) {
+                    for (size_t j = 0; j < nr; j++) { ci[j] = alpha * acc[i][j]; }
+                } else {
+                    for (size_t j = 0; j < nr; j++) { ci[j] = alpha * acc[i][j] + beta * ci[j]; }
+                }
+                if (last) {
+                    for (size_t j = 0; j < nr; j++) { ci[j] = epilogue(col + j, ci[j]); }
+                }
+            }
+        }
+
+        template<typename T, typename Epilogue>
+        void scale(size_t m, size_t n, T beta, T *c, size_t ldc, Epilogue const &epilogue) {
+            for (size_t i = 0; i < m; i++) {
+                T *ci = c + i * ldc;
+                for (size_t j = 0; j < n; j++) {
+                    ci[j] = epilogue(j, (beta == T(0)) ? T(0) : beta * ci[j]);
+                }
+            }
+        }
+    }
+
+    // C(m, n) = epilogue(alpha * op(A)(m, k) * op(B)(k, n) + beta * C(m, n))
+    // when beta is zero C is not read (may be uninitialized)
+    // epilogue is applied to every element while its tile is still in cache
+    template<typename T, typename Epilogue = identity_epilogue_t>
+    void gemm(transpose_type trans_a, transpose_type trans_b,
+              size_t m, size_t n, size_t k,
+              T alpha,
+              T const *a, size_t lda,
+              T const *b, size_t ldb,
+              T beta,
+              T *c, size_t ldc,
+              int threads = omp_get_max_threads(),
+              Epilogue const &epilogue = Epilogue()) {
+        const size_t MR = gemm_blocking_t<T>::MR, NR = gemm_blocking_t<T>::NR;
+        const size_t MC = gemm_blocking_t<T>::MC, KC = gemm_blocking_t<T>::KC;
+        const size_t NC = gemm_blocking_t<T>::NC;
+
+        if (m == 0 || n == 0) { return; }
+        if (k == 0 || alpha == T(0)) {
+            detail::scale(m, n, beta, c, ldc, epilogue);
+            return;
+        }
+
+        // element (i, j) of op(X) is x[i * row_stride + j * col_stride]
+        const size_t a_rs = (trans_a == transpose_type::no) ? lda : 1;
+        const size_t a_cs = (trans_a == transpose_type::no) ? 1 : lda;
+        const size_t b_rs = (trans_b == transpose_type::no) ? ldb : 1;
+        const size_t b_cs = (trans_b == transpose_type::no) ? 1 : ldb;
+
+        const size_t m_blocks = (m + MC - 1) / MC;
+        const int thread_count = detail::gemm_threads(threads);
+
+        // shared packed panel of B, reused by all blocks of A
+        aligned_vector_t<T> b_pack(KC * ((std::min(NC, n) + NR - 1) / NR) * NR);
+
+#   pragma omp parallel num_threads(thread_count)
+{
+        aligned_vector_t<T> a_pack(MC * KC);
+        const int team_size = omp_get_num_threads();
+
+        for (size_t jc = 0; jc < n; jc += NC) {
+            const size_t nc = std::min(NC, n - jc);
+            const size_t n_panels = (nc + NR - 1) / NR;
+            // split columns of the panel into groups so that
+            // the team has enough work items even for few blocks of A
+            const size_t group = std::max<size_t>(1, (n_panels * m_blocks) / (4 * team_size));
+            const size_t n_groups = (n_panels + group - 1) / group;
+
+            for (size_t pc = 0; pc < k; pc += KC) {
+                const size_t kc = std::min(KC, k - pc);
+                // beta is applied only once, next panels of k accumulate
+                const T beta_pc = (pc == 0) ? beta : T(1);
+
+#   pragma omp for schedule(static)
+                for (long jp = 0; jp < (long)n_panels; jp++) {
+                    const size_t jr = jp * NR;
+                    detail::pack_b_panel(kc, std::min(NR, nc - jr),
+                                         b + pc * b_rs + (jc + jr) * b_cs, b_rs, b_cs,
+                                         &b_pack[jp * NR * kc]);
+                }
+
+                size_t packed_block = m_blocks;
+#   pragma omp for collapse(2) schedule(static)
+                for (long ib = 0; ib < (long)m_blocks; ib++) {
+                    for (long ig = 0; ig < (long)n_groups; ig++) {
+                        const size_t ic = ib * MC;
+                        const size_t mc = std::min(MC, m - ic);
+                        // consecutive work items mostly share same block of A
+                        if (packed_block != (size_t)ib) {
+                            detail::pack_a(mc, kc, a + ic * a_rs + pc * a_cs, a_rs, a_cs, &a_pack[0]);
+                            packed_block = ib;
+                        }
+
+                        const size_t jp_end = std::min(n_panels, (ig + 1) * group);
+                        for (size_t jp = ig * group; jp < jp_end; jp++) {
+                            const size_t jr = jp * NR;
+                            const size_t nr = std::min(NR, nc - jr);
+                            for (size_t ir = 0; ir < mc; ir += MR) {
+                                detail::gemm_micro_kernel(kc,
+                                                          &a_pack[ir * kc], &b_pack[jp * NR * kc],
+                                                          c + (ic + ir) * ldc + jc + jr, ldc,
+                                                          std::min(MR, mc - ir), nr,
+                                                          alpha, beta_pc,
+                                                          epilogue, jc + jr, pc + kc == k);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+}
+    }
+
+    // y = alpha * op(A) * x + beta * y
+    // A is stored as (m, n) matrix so y has m elements if not transposed and n otherwise
+    template<typename T>
+    void gemv(transpose_type trans,
+              size_t m, size_t n,
+              T alpha,
+              T const *a, size_t lda,
+              T const *x,
+              T beta,
+              T *y,
+              int threads = omp_get_max_threads()) {
+        const int thread_count = detail::gemm_threads(threads);
+
+        if (trans == transpose_type::no) {
+            // every row is a contiguous dot product
+#   pragma omp parallel for num_threads(thread_count) schedule(static)
+            for (long i = 0; i < (long)m; i++) {
+                T const *row = a + i * lda;
+                T sum = T(0);
+#   pragma omp simd reduction(+:sum)
+                for (size_t j = 0; j < n; j++) {
+                    sum += row[j] * x[j];
+                }
+                y[i] = alpha * sum + ((beta == T(0)) ? T(0) : beta * y[i]);
+            }
+        } else {
+            // each thread streams its own range of whole rows (sequential reads of A)
+            // into a private partial y, four rows at a time to cut the partial's traffic;
+            // partials are summed column-wise at the end
+            aligned_vector_t<T> partials(thread_count * n, T(0));
+
+#   pragma omp parallel num_threads(thread_count)
+{
+            // team may be smaller than requested, unused partials stay zero
+            const size_t team_size = omp_get_num_threads();
+            const size_t rows_per_thread = (m + team_size - 1) / team_size;
+            const size_t t = omp_get_thread_num();
+            const size_t i0 = std::min(m, t * rows_per_thread);
+            const size_t i1 = std::min(m, i0 + rows_per_thread);
+            T *yt = partials.data() + t * n;
+            size_t i = i0;
+            for (; i + 4 <= i1; i += 4) {
+                T const *r0 = a + i * lda, *r1 = r0 + lda, *r2 = r1 + lda, *r3 = r2 + lda;
+                const T x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+#   pragma omp simd
+                for (size_t j = 0; j < n; j++) {
+                    yt[j] += x0 * r0[j] + x1 * r1[j] + x2 * r2[j] + x3 * r3[j];
+                }
+            }
+            for (; i < i1; i++) {
+                T const *row = a + i * lda;
+                const T xi = x[i];
+#   pragma omp simd
+                for (size_t j = 0; j < n; j++) {
+                    yt[j] += xi * row[j];
+                }
+            }
+
+#   pragma omp barrier
+#   pragma omp for schedule(static)
+            for (long j = 0; j < (long)n; j++) {
+                T sum = T(0);
+                for (int p = 0; p < thread_count; p++) { sum += partials[p * n + j]; }
+                y[j] = alpha * sum + ((beta == T(0)) ? T(0) : beta * y[j]);
+            }
+}
+        }
+    }
+
+    // rank-1 update A(m, n) = alpha * x(m) * y(n)^T + A(m, n)
+    template<typename T>
+    void ger(size_t m, size_t n,
+             T alpha,
+             T const *x, T const *y,
+             T *a, size_t lda,
+             int threads = omp_get_max_threads()) {
+        const int thread_count = detail::gemm_threads(threads);
+
+#   pragma omp parallel for num_threads(thread_count) schedule(static)
+        for (long i = 0; i < (long)m; i++) {
+            T *row = a + i * lda;
+            const T xi = alpha * x[i];
+#   pragma omp simd
+            for (size_t j = 0; j < n; j++) {
+                row[j] += xi * y[j];
+            }
+        }
+    }
+}
+
+#endif // GEMM_H
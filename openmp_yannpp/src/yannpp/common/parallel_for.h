@@ -0,0 +1,78 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <cstddef>
+
+#include <omp.h>
+
+#include <yannpp/common/execution_context.h>
+
+namespace yannpp {
+    // how iterations are distributed between threads
+    enum struct schedule_type {
+        blocked, // one contiguous range of whole grains per thread (static)
+        dynamic, // grains are taken by free threads one by one
+        guided   // same with decreasing chunks of at least one grain
+    };
+
+    // calls f(i) for i in [begin, end) in parallel
+    // work is the total amount of work of the loop in units of op (see parallel_op)
+    // loop runs in the calling thread without forking a team if the work is below
+    // the context threshold, if there's only one grain or if already inside of parallel region
+    // grain is the minimal number of consecutive iterations given to a thread
+    template<typename F>
+    void parallel_for(execution_context_t const &context, parallel_op op, size_t work,
+                      size_t begin, size_t end, F const &f,
+                      size_t grain = 1, schedule_type schedule = schedule_type::blocked) {
+        if (end <= begin) { return; }
+
+        grain = std::max<size_t>(1, grain);
+        const size_t grains = (end - begin + grain - 1) / grain;
+        const int threads = (int)std::min<size_t>(grains, (size_t)context.threads_for(op, work));
+
+        if (threads <= 1 || omp_in_parallel()) {
+            for (size_t i = begin; i < end; i++) { f(i); }
+            return;
+        }
+
+        switch (schedule) {
+        case schedule_type::blocked:
+#   pragma omp parallel num_threads(threads)
+{
+            const size_t rank = omp_get_thread_num();
+            const size_t count = omp_get_num_threads();
+            const size_t local = grains / count;
+            const size_t sub = grains % count;
+            const size_t first = rank * local + std::min(rank, sub);
+            const size_t last = first + local + (rank < sub ? 1 : 0);
+            const size_t i_end = std::min(end, begin + last * grain);
+            for (size_t i = begin + first * grain; i < i_end; i++) { f(i); }
+}
+            break;
+
+        case schedule_type::dynamic:
+#   pragma omp parallel for num_threads(threads) schedule(dynamic, grain)
+            for (long i = (long)begin; i < (long)end; i++) { f((size_t)i); }
+            break;
+
+        case schedule_type::guided:
+#   pragma omp parallel for num_threads(threads) schedule(guided, grain)
+            for (long i = (long)begin; i < (long)end; i++) { f((size_t)i); }
+            break;
+        }
+    }
+
+    // calls f(i, j) for i in [0, n0) and j in [0, n1) as one collapsed loop
+    // so small n0 (e.g. batch size) still gives enough iterations for all threads
+    template<typename F>
+    void parallel_for_2d(execution_context_t const &context, parallel_op op, size_t work,
+                         size_t n0, size_t n1, F const &f,
+                         size_t grain = 1, schedule_type schedule = schedule_type::blocked) {
+        if (n1 == 0) { return; }
+        auto collapsed = [&f, n1](size_t i) { f(i / n1, i % n1); };
+        parallel_for(context, op, work, 0, n0 * n1, collapsed, grain, schedule);
+    }
+}
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,54 @@
+#ifndef THREAD_SCRATCH_H
+#define THREAD_SCRATCH_H
+
+#include <cassert>
+#include <cstddef>
+
+#include <omp.h>
+
+#include <yannpp/common/allocator.h>
+#include <yannpp/common/execution_context.h>
+
+namespace yannpp {
+    // scratch memory of every thread running tasks of parallel_for() with given context,
+    // allocated once and reused between calls: prepare() before the loop, data() in its tasks
+    // a loop started inside of a parallel region runs in the calling thread (see parallel_for)
+    // so then there's a single slot and the thread number of the outer team is not used
+    template<typename T>
+    class thread_scratch_t {
+    public:
+        void prepare(execution_context_t const &context, size_t size) {
+            nested_ = omp_in_parallel();
+            const size_t slots = nested_ ? 1 : (size_t)context.threads();
+            if (size != size_ || slots != slots_) {
+                buffer_ = aligned_vector_t<T>(slots * size);
+                size_ = size;
+                slots_ = slots;
+            }
+        }
+
+        // size() elements of the calling thread
+        T *data() {
+            const size_t slot = nested_ ? 0 : (size_t)omp_get_thread_num();
+            assert(slot < slots_);
+            return buffer_.data() + slot * size_;
+        }
+
+        inline size_t size() const { return size_; }
+
+        // slots prepared for the loop, e.g. to reduce per-thread results after it
+        inline size_t slots() const { return slots_; }
+        T *slot(size_t i) {
+            assert(i < slots_);
+            return buffer_.data() + i * size_;
+        }
+
+    private:
+        aligned_vector_t<T> buffer_;
+        size_t size_ = 0;
+        size_t slots_ = 0;
+        bool nested_ = false;
+    };
+}
+
+#endif // THREAD_SCRATCH_H
@@ -0,0 +1,85 @@
+#ifndef TUNING_CACHE_H
+#define TUNING_CACHE_H
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+namespace yannpp {
+    // name of the cpu without spaces (e.g. Intel(R)_Xeon(R)_Gold_6248_CPU_@_2.50GHz)
+    // so that tuning results of different machines sharing the same cache don't mix
+    inline std::string cpu_model_name() {
+        std::string name;
+#if defined(__linux__)
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                const size_t colon = line.find(':');
+                if (colon != std::string::npos) { name = line.substr(line.find_first_not_of(' ', colon + 1)); }
+                break;
+            }
+        }
+#elif defined(__APPLE__)
+        char buffer[256] = {0};
+        size_t size = sizeof(buffer);
+        if (sysctlbyname("machdep.cpu.brand_string", buffer, &size, nullptr, 0) == 0) { name = buffer; }
+#endif
+        if (name.empty()) { name = "unknown"; }
+        for (auto &c: name) { if (c == ' ' || c == '\t') { c = '_'; } }
+        return name;
+    }
+
+    // persistent key -> value map of autotuning results, one "key value" line per entry
+    // keys have no whitespace, later lines override earlier ones
+    // path is YANNPP_TUNING_CACHE (yannpp_tuning.txt in the working directory by default),
+    // empty path keeps results in memory only
+    class tuning_cache_t {
+    public:
+        explicit tuning_cache_t(std::string const &path = default_path()): path_(path) {
+            if (path_.empty()) { return; }
+            std::ifstream file(path_);
+            std::string line;
+            while (std::getline(file, line)) {
+                std::istringstream fields(line);
+                std::string key, value;
+                if (fields >> key && std::getline(fields >> std::ws, value)) { entries_[key] = value; }
+            }
+        }
+
+        static std::string default_path() {
+            const char *path = std::getenv("YANNPP_TUNING_CACHE");
+            return (path != nullptr) ? std::string(path) : std::string("yannpp_tuning.txt");
+        }
+
+    public:
+        inline std::string const &path() const { return path_; }
+
+        bool find(std::string const &key, std::string &value) const {
+            auto it = entries_.find(key);
+            if (it == entries_.end()) { return false; }
+            value = it->second;
+            return true;
+        }
+
+        // appends to the file so concurrent runs lose at most their own entries
+        void store(std::string const &key, std::string const &value) {
+            entries_[key] = value;
+            if (path_.empty()) { return; }
+            std::ofstream file(path_, std::ios::app);
+            file << key << " " << value << "\n";
+        }
+
+    private:
+        std::string path_;
+        std::map<std::string, std::string> entries_;
+    };
+}
+
+#endif // TUNING_CACHE_H
@@ -0,0 +1,84 @@
+#ifndef VIEW3D_H
+#define VIEW3D_H
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+#include <yannpp/common/shape.h>
+
+namespace yannpp {
+    // non-owning view over (X, Y, Z) block of memory with the same layout as array3d_t:
+    // z is contiguous, x and y are walked with precomputed strides
+    // so view of a window inside of bigger array is a view as well
+    // indexing is not checked in release builds (asserts only)
+    template<typename T>
+    class view3d_t {
+    public:
+        view3d_t(T *data, shape3d_t const &shape):
+            data_(data),
+            shape_(shape),
+            x_stride_((size_t)shape.y() * shape.z()),
+            y_stride_((size_t)shape.z())
+        { }
+
+        view3d_t(T *data, shape3d_t const &shape, size_t x_stride, size_t y_stride):
+            data_(data),
+            shape_(shape),
+            x_stride_(x_stride),
+            y_stride_(y_stride)
+        { }
+
+        // view3d_t<T> -> view3d_t<T const>
+        template<typename Q, typename = typename std::enable_if<std::is_convertible<Q*, T*>::value>::type>
+        view3d_t(view3d_t<Q> const &other):
+            data_(other.data()),
+            shape_(other.shape()),
+            x_stride_(other.x_stride()),
+            y_stride_(other.y_stride())
+        { }
+
+    public:
+        inline T *data() const { return data_; }
+        inline shape3d_t const &shape() const { return shape_; }
+        inline size_t x_stride() const { return x_stride_; }
+        inline size_t y_stride() const { return y_stride_; }
+        inline bool is_contiguous() const {
+            return (y_stride_ == (size_t)shape_.z()) && (x_stride_ == y_stride_ * shape_.y());
+        }
+
+        inline bool in_bounds(int x, int y, int z) const {
+            return ((0 <= x) && (x < shape_.x())) &&
+                    ((0 <= y) && (y < shape_.y())) &&
+                    ((0 <= z) && (z < shape_.z()));
+        }
+
+        inline size_t offset(int x, int y, int z) const {
+            assert(in_bounds(x, y, z));
+            return x * x_stride_ + y * y_stride_ + z;
+        }
+
+        inline T &operator()(int x, int y, int z) const { return data_[offset(x, y, z)]; }
+        inline T &operator()(index3d_t const &i) const { return data_[offset(i.x(), i.y(), i.z())]; }
+        // beginning of contiguous run of z values at (x, y)
+        inline T *ptr(int x, int y) const { return data_ + offset(x, y, 0); }
+
+        // view of the window of given shape starting at start (has to be inside)
+        view3d_t<T> window(index3d_t const &start, shape3d_t const &shape) const {
+            assert(in_bounds(start.x(), start.y(), start.z()));
+            assert(in_bounds(start.x() + shape.x() - 1,
+                             start.y() + shape.y() - 1,
+                             start.z() + shape.z() - 1));
+            return view3d_t<T>(data_ + offset(start.x(), start.y(), start.z()),
+                               shape, x_stride_, y_stride_);
+        }
+
+    private:
+        T *data_;
+        shape3d_t shape_;
+        size_t x_stride_;
+        size_t y_stride_;
+    };
+}
+
+#endif // VIEW3D_H
@@ -4,14 +4,15 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
-#include <deque>
 #include <vector>
 #include <iostream>
 
 #include <yannpp/common/array3d.h>
 #include <yannpp/common/array3d_math.h>
+#include <yannpp/common/array4d.h>
 #include <yannpp/common/shape.h>
 #include <yannpp/common/utils.h>
+#include <yannpp/layers/layer_activation.h>
 #include <yannpp/layers/layer_base.h>
 #include <yannpp/layers/layer_metadata.h>
 #include <yannpp/network/activator.h>
@@ -33,7 +34,7 @@ namespace yannpp
     array3d_t<T> unvectorize(std::vector<array3d_t<T>> const &vectorized)
     {
         const size_t size = vectorized.size();
-        std::vector<T> result;
+        typename array3d_t<T>::storage_type result;
         result.reserve(size);
         for (size_t i = 0; i < size; i++)
         {
@@ -42,16 +43,21 @@ namespace yannpp
         return array3d_t<T>(shape3d_t(result.size(), 1, 1), std::move(result));
     }
 
-    template <typename T>
+    // Activation is either activator_t<T> or one of compile-time policies
+    // (e.g. convolution_layer_loop_t<float, relu_activation_t>)
+    template <typename T, typename Activation = activator_t<T>>
     class convolution_layer_base_t : public layer_base_t<T>
     {
+    protected:
+        using activation_type = layer_activation_t<T, Activation>;
+
     public:
         convolution_layer_base_t(shape3d_t const &input_shape,
                                  shape3d_t const &filter_shape,
                                  int filters_number,
                                  int stride_length,
                                  padding_type padding,
-                                 activator_t<T> const &activator,
+                                 typename activation_type::argument_type const &activation = typename activation_type::argument_type(),
                                  layer_metadata_t const &metadata = {}) : layer_base_t<T>(metadata),
                                                                           input_shape_(input_shape),
                                                                           filter_shape_(filter_shape),
@@ -61,7 +67,7 @@ namespace yannpp
                                                                                       filters_number),
                                                                           stride_(stride_length, stride_length, 0),
                                                                           padding_(padding),
-                                                                          activator_(activator)
+                                                                          activation_(activation)
         {
             assert(filter_shape.z() == input_shape.z());
         }
@@ -69,48 +75,30 @@ namespace yannpp
     public:
         virtual void init() override
         {
-            assert(filter_weights_.size() == filter_biases_.size());
-
             const int filters_number = conv_shape_.z();
+            const int filter_size = filter_shape_.capacity();
 
-            if (filter_weights_.empty())
+            // all neurons in each filter share same weights and bias
+            if (filter_weights_.size() == 0)
             {
-                filter_weights_.reserve(filters_number);
-                filter_biases_.reserve(filters_number);
-
-                // all neurons in each filter share same weights and bias
-                for (int i = 0; i < filters_number; i++)
-                {
-                    filter_weights_.emplace_back(
-                        filter_shape_,
-                        T(0), T(1) / sqrt((T)filter_shape_.capacity()));
-                    filter_biases_.emplace_back(shape_row(1), T(0));
-                }
+                filter_weights_ = array3d_t<T>(shape3d_t(filters_number, filter_size, 1),
+                                               T(0), T(1) / sqrt((T)filter_size));
+                filter_biases_ = array3d_t<T>(shape_row(filters_number), T(0));
             }
 
-            if (nabla_weights_.empty())
+            if (nabla_weights_.size() == 0)
             {
-                nabla_weights_.reserve(filters_number);
-                nabla_biases_.reserve(filters_number);
-
-                for (int i = 0; i < filters_number; i++)
-                {
-                    nabla_weights_.emplace_back(filter_shape_, T(0));
-                    nabla_biases_.emplace_back(shape_row(1), T(0));
-                }
+                nabla_weights_ = array3d_t<T>(shape3d_t(filters_number, filter_size, 1), T(0));
+                nabla_biases_ = array3d_t<T>(shape_row(filters_number), T(0));
             }
         }
 
         virtual void optimize(optimizer_t<T> const &strategy) override
         {
-            const size_t filters_size = filter_weights_.size();
-            for (size_t i = 0; i < filters_size; i++)
-            {
-                strategy.update_weights(filter_weights_[i], nabla_weights_[i]);
-                strategy.update_bias(filter_biases_[i], nabla_biases_[i]);
-                nabla_weights_[i].reset(0);
-                nabla_biases_[i].reset(0);
-            }
+            strategy.update_weights(filter_weights_, nabla_weights_);
+            strategy.update_bias(filter_biases_, nabla_biases_);
+            nabla_weights_.reset(0);
+            nabla_biases_.reset(0);
         }
 
         virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) override
@@ -122,8 +110,15 @@ namespace yannpp
             assert(std::all_of(biases.begin(), biases.end(), [this](array3d_t<T> const &b)
                                { return (b.size() == 1 && b.shape().dim() == 0); }));
 
-            filter_weights_ = std::move(weights);
-            filter_biases_ = std::move(biases);
+            const int filters_number = conv_shape_.z();
+            const size_t filter_size = filter_shape_.capacity();
+            filter_weights_ = array3d_t<T>(shape3d_t(filters_number, filter_size, 1), T(0));
+            filter_biases_ = array3d_t<T>(shape_row(filters_number), T(0));
+            for (int fi = 0; fi < filters_number; fi++)
+            {
+                std::copy(weights[fi].raw(), weights[fi].raw() + filter_size, filter_weights_.raw() + fi * filter_size);
+                filter_biases_(fi) = biases[fi](0);
+            }
         }
 
         shape3d_t get_output_shape() const
@@ -139,6 +134,19 @@ namespace yannpp
         }
 
     protected:
+        inline size_t filters_count() const { return conv_shape_.z(); }
+
+        // filter fi and its gradient are rows of the weights blocks
+        inline T const *filter_data(size_t fi) const { return filter_weights_.raw() + fi * filter_shape_.capacity(); }
+        inline T *nabla_data(size_t fi) { return nabla_weights_.raw() + fi * filter_shape_.capacity(); }
+        inline view3d_t<T const> filter_view(size_t fi) const { return view3d_t<T const>(filter_data(fi), filter_shape_); }
+
+        // number of multiply-adds of the convolution of one sample
+        size_t convolution_work() const
+        {
+            return get_output_shape().capacity() * filter_shape_.capacity();
+        }
+
         int get_top_padding() const
         {
             if (padding_ == padding_type::valid)
@@ -157,6 +165,97 @@ namespace yannpp
             return utils::get_left_padding(input_shape_, filter_shape_, stride_.x());
         }
 
+        // input surrounded by zero halo so that every convolution window lies inside
+        shape3d_t get_padded_shape() const
+        {
+            const shape3d_t output_shape = get_output_shape();
+            const int width = std::max(input_shape_.x() + get_left_padding(),
+                                       (output_shape.x() - 1) * stride_.x() + filter_shape_.x());
+            const int height = std::max(input_shape_.y() + get_top_padding(),
+                                        (output_shape.y() - 1) * stride_.y() + filter_shape_.y());
+            return shape3d_t(width, height, input_shape_.z());
+        }
+
+        // padded copy of the input in the persistent buffer, halo is zeroed only when
+        // the buffer is created and interior is overwritten by every input
+        view3d_t<T const> padded_input(array3d_t<T> const &input)
+        {
+            const shape3d_t padded_shape = get_padded_shape();
+            if (padded_shape == input_shape_) { return input.view(); }
+            if (padded_input_.shape() != padded_shape) { padded_input_ = array3d_t<T>(padded_shape, T(0)); }
+            copy_to_padded(input.view(), padded_input_.view());
+            return padded_input_.view();
+        }
+
+        // same for samples of the minibatch, prepare_batch_padding() has to be called first
+        // so that samples can be padded in parallel
+        void prepare_batch_padding(size_t batch_size)
+        {
+            const shape3d_t padded_shape = get_padded_shape();
+            if (padded_shape == input_shape_) { return; }
+            if (batch_padded_input_.batch_size() != batch_size || batch_padded_input_.shape() != padded_shape)
+            {
+                batch_padded_input_ = array4d_t<T>(batch_size, padded_shape, T(0));
+            }
+        }
+
+        view3d_t<T const> padded_input(array3d_t<T> const &input, size_t n)
+        {
+            if (get_padded_shape() == input_shape_) { return input.view(); }
+            copy_to_padded(input.view(), batch_padded_input_.view(n));
+            return batch_padded_input_.view(n);
+        }
+
+        // padded views of all samples of batch_inputs_
+        std::vector<view3d_t<T const>> padded_batch_inputs()
+        {
+            const size_t batch_size = batch_inputs_.size();
+            prepare_batch_padding(batch_size);
+            std::vector<view3d_t<T const>> padded(batch_size, view3d_t<T const>(nullptr, input_shape_));
+            this->parallel_for(parallel_op::elementwise, batch_size * input_shape_.capacity(), 0, batch_size, [&](size_t n)
+            {
+                padded[n] = padded_input(batch_inputs_[n], n);
+            });
+            return padded;
+        }
+
+        // number of tiles of output rows so that (tasks x tiles) gives every thread
+        // a few work items whatever the number of filters (1 if work isn't worth threads)
+        int row_tiles(size_t tasks, size_t work) const
+        {
+            const size_t threads = this->threads_for(parallel_op::convolution, work);
+            if (threads <= 1 || tasks == 0) { return 1; }
+            const size_t tiles = (4 * threads + tasks - 1) / tasks;
+            return (int)std::max<size_t>(1, std::min<size_t>(tiles, get_output_shape().x()));
+        }
+
+        // interior of the padded gradient (the part that matches the input)
+        void copy_from_padded(view3d_t<T const> const &padded, view3d_t<T> const &output) const
+        {
+            const int pad_x = get_left_padding();
+            const int pad_y = get_top_padding();
+            const size_t run = (size_t)input_shape_.y() * input_shape_.z();
+            for (int x = 0; x < input_shape_.x(); x++)
+            {
+                T const *from = padded.ptr(x + pad_x, pad_y);
+                std::copy(from, from + run, output.ptr(x, 0));
+            }
+        }
+
+    private:
+        void copy_to_padded(view3d_t<T const> const &input, view3d_t<T> const &padded) const
+        {
+            const int pad_x = get_left_padding();
+            const int pad_y = get_top_padding();
+            // (y, z) plane of the input is one contiguous run in both arrays
+            const size_t run = (size_t)input_shape_.y() * input_shape_.z();
+            for (int x = 0; x < input_shape_.x(); x++)
+            {
+                T const *from = input.ptr(x, 0);
+                std::copy(from, from + run, padded.ptr(x + pad_x, pad_y));
+            }
+        }
+
     protected:
         shape3d_t input_shape_;
         shape3d_t filter_shape_;
@@ -164,21 +263,31 @@ namespace yannpp
         shape3d_t conv_shape_;
         point3d_t<int> stride_;
         const padding_type padding_;
-        activator_t<T> const &activator_;
-        std::vector<array3d_t<T>> filter_weights_;
-        std::vector<array3d_t<T>> filter_biases_;
+        activation_type activation_;
+        // weights of all filters as [filters_number, filter_size] block (row fi is
+        // filter fi in (x, y, z) order) and all biases as one row
+        array3d_t<T> filter_weights_;
+        array3d_t<T> filter_biases_;
         // calculation support
+        // output_ is z for activator_t and a = f(z) for compile-time policies
         array3d_t<T> input_, output_;
-        std::vector<array3d_t<T>> nabla_weights_;
-        std::vector<array3d_t<T>> nabla_biases_;
+        // gradients in the same layout as weights and biases
+        array3d_t<T> nabla_weights_;
+        array3d_t<T> nabla_biases_;
+        // samples of the last minibatch and their convolution results
+        std::vector<array3d_t<T>> batch_inputs_;
+        array4d_t<T> batch_output_;
+        // zero padded inputs reused between calls
+        array3d_t<T> padded_input_;
+        array4d_t<T> batch_padded_input_;
     };
 
-    template <typename T>
-    class convolution_layer_loop_t : public convolution_layer_base_t<T>
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_loop_t : public convolution_layer_base_t<T, Activation>
     {
     public:
         // use same constructor
-        using convolution_layer_base_t<T>::convolution_layer_base_t;
+        using convolution_layer_base_t<T, Activation>::convolution_layer_base_t;
 
     public:
         virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
@@ -189,209 +298,269 @@ namespace yannpp
             const shape3d_t output_shape = this->get_output_shape();
             array3d_t<T> result(output_shape, 0);
 
-            const int pad_x = this->get_left_padding();
-            const int pad_y = this->get_top_padding();
-
-            const int fsize = this->filter_weights_.size();
-            auto &filter_shape = this->filter_shape_;
-            auto &input_shape = this->input_.shape();
-            // perform convolution for each filter
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = fsize / thread_count;
-            size_t sub = fsize % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (int fi = start; fi < end; fi++)
-            {
-                auto filter = this->filter_weights_[fi].slice();
-                auto &bias = this->filter_biases_[fi](0);
-                // 2D loop over the input and calculation convolution of input and current filter
-                // convolution is S(i, j) = (I ∗ K)(i, j) = Sum[ I(m, n)K(i − m, j − n) ]
-                // which is commutative i.e. (I ∗ K)(i, j) = Sum[ I(i - m, j - n)K(m, n) ]
-                // where I is input and K is kernel (filter weights)
-                for (int y = 0; y < output_shape.y(); y++)
-                {
-                    int ys = y * this->stride_.y() - pad_y;
-
-                    for (int x = 0; x < output_shape.x(); x++)
-                    {
-                        int xs = x * this->stride_.x() - pad_x;
-                        // in this case cross-correlation (I(m, n)K(i + m, j + n)) is used
-                        // (kernel is not rot180() flipped for the convolution, not commutative)
-                        // previous formula (w*x + b) is used with convolution instead of product
-                        result(x, y, fi) =
-                            bias +
-                            dot<T>(
-                                this->input_.slice(
-                                    index3d_t(xs, ys, 0),
-                                    index3d_t(xs + filter_shape.x() - 1,
-                                              ys + filter_shape.y() - 1,
-                                              input_shape.z() - 1)),
-                                filter);
-                    }
-                }
-            }
-}
+            const size_t fsize = this->filters_count();
+            const size_t work = this->convolution_work();
+            const int tiles = this->row_tiles(fsize, work);
+            view3d_t<T const> in = this->padded_input(this->input_);
+            view3d_t<T> out = result.view();
+            // perform convolution for each filter and tile of output rows
+            // so that there is enough work for all threads even with few filters
+            this->parallel_for_2d(parallel_op::convolution, work, fsize, tiles, [&](size_t fi, size_t t)
+            {
+                convolve_filter(in, fi, out, tile_begin(t, tiles), tile_begin(t + 1, tiles));
+            });
 
             this->output_ = std::move(result);
-            return this->activator_.activate(this->output_);
+            return this->activation_.activate(this->output_);
         }
 
         virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
         {
             // error shape was already transformed in the prev layer as delta(l+1)(*)rot180(w(l+1))
             assert(error.shape() == this->output_.shape());
-            auto &error_shape = error.shape();
             // gradients with regards to input of this layer
-            array3d_t<T> delta;
-            delta = this->activator_.derivative(this->output_);
-            delta.element_mul(error);
+            array3d_t<T> delta = this->activation_.delta(this->output_, std::move(error));
 
-            const int pad_x = this->get_left_padding();
-            const int pad_y = this->get_top_padding();
-
-            const size_t fsize = this->filter_weights_.size();
-            auto &filter_shape = this->filter_shape_, &input_shape = this->input_shape_;
-            auto &stride = this->stride_;
             // calculate nabla_w for each filter
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = fsize / thread_count;
-            size_t sub = fsize % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (int fi = start; fi < end; fi++)
-            {
-                auto &nabla_w = this->nabla_weights_[fi];
-                auto &nabla_b = this->nabla_biases_[fi](0);
-                auto delta_fi = delta.slice(dim_type::Z, fi, fi);
-                // dC/db = delta(l)
-                nabla_b += delta_fi.sum();
-
-                for (int z = 0; z < input_shape.z(); z++)
+            std::vector<view3d_t<T const>> inputs(1, this->padded_input(this->input_));
+            std::vector<view3d_t<T const>> deltas(1, delta.view());
+            accumulate_nabla(inputs, deltas);
+
+            array3d_t<T> delta_next(this->input_shape_, T(0));
+
+            // input gradient of next layer is scaled by weights gradient of this layer
+            // gradient for the next layer is delta(l) (*) rot180(w(l))
+            // so for delta we apply "full" convolution with filter
+            // all filters contribute to every element so threads split rows of the result
+            view3d_t<T> out = delta_next.view();
+            this->parallel_for(parallel_op::convolution, this->convolution_work(), 0, this->input_shape_.x(),
+                               [&](size_t x) { accumulate_delta_next(delta, out, x, x + 1); });
+
+            return delta_next;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+
+            this->batch_inputs_ = input.samples();
+            const size_t batch_size = input.batch_size();
+            const shape3d_t output_shape = this->get_output_shape();
+            array4d_t<T> result(batch_size, output_shape, T(0));
+            std::vector<view3d_t<T const>> padded = this->padded_batch_inputs();
+
+            // every (sample, filter, rows tile) is an independent convolution
+            const size_t fsize = this->filters_count();
+            const size_t work = batch_size * this->convolution_work();
+            const int tiles = this->row_tiles(batch_size * fsize, work);
+            this->parallel_for_2d(parallel_op::convolution, work, batch_size * fsize, tiles, [&](size_t i, size_t t)
+            {
+                const size_t n = i / fsize;
+                convolve_filter(padded[n], i % fsize, result.view(n), tile_begin(t, tiles), tile_begin(t + 1, tiles));
+            });
+
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            assert(error.shape() == this->batch_output_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = this->activation_.delta(this->batch_output_, std::move(error));
+            auto deltas = delta.samples();
+
+            // each filter accumulates gradients of the whole minibatch
+            std::vector<view3d_t<T const>> delta_views;
+            for (size_t n = 0; n < batch_size; n++) { delta_views.push_back(deltas[n].view()); }
+            accumulate_nabla(this->padded_batch_inputs(), delta_views);
+
+            // input gradients of different samples are independent
+            const size_t work = batch_size * this->convolution_work();
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            this->parallel_for_2d(parallel_op::convolution, work, batch_size, this->input_shape_.x(),
+                                  [&](size_t n, size_t x) { accumulate_delta_next(deltas[n], delta_next.view(n), x, x + 1); });
+
+            return delta_next;
+        }
+
+    protected:
+        // first output row of the tile t of tiles
+        inline int tile_begin(size_t t, int tiles) const
+        {
+            return (int)(t * this->get_output_shape().x() / tiles);
+        }
+
+        // writes convolution of padded input with filter fi into the layer fi of out
+        // for output rows [x0, x1)
+        void convolve_filter(view3d_t<T const> const &in, int fi, view3d_t<T> const &out, int x0, int x1)
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            auto &filter_shape = this->filter_shape_;
+            // (y, z) plane of the window is contiguous in padded input and in the filter
+            const int run = filter_shape.y() * filter_shape.z();
+
+            view3d_t<T const> filter = this->filter_view(fi);
+            const T bias = this->filter_biases_(fi);
+            // 2D loop over the input and calculation convolution of input and current filter
+            // convolution is S(i, j) = (I ∗ K)(i, j) = Sum[ I(m, n)K(i − m, j − n) ]
+            // which is commutative i.e. (I ∗ K)(i, j) = Sum[ I(i - m, j - n)K(m, n) ]
+            // where I is input and K is kernel (filter weights)
+            for (int x = x0; x < x1; x++)
+            {
+                int xs = x * this->stride_.x();
+
+                for (int y = 0; y < output_shape.y(); y++)
                 {
-                    // convolution of input and filter gives us output (same as error size)
-                    // and convolution of input and error gives us filter size
-                    for (int y = 0; y < filter_shape.y(); y++)
+                    int ys = y * this->stride_.y();
+                    // in this case cross-correlation (I(m, n)K(i + m, j + n)) is used
+                    // (kernel is not rot180() flipped for the convolution, not commutative)
+                    // previous formula (w*x + b) is used with convolution instead of product
+                    T sum = 0;
+                    for (int fx = 0; fx < filter_shape.x(); fx++)
                     {
-                        int ys = y * stride.y() - pad_y;
-
-                        for (int x = 0; x < filter_shape.x(); x++)
-                        {
-                            int xs = x * stride.x() - pad_x;
-
-                            // dC/dw = a(l-1) (x) delta(l)
-                            nabla_w(x, y, z) +=
-                                dot<T>(
-                                    this->input_.slice(
-                                        index3d_t(xs, ys, z),
-                                        index3d_t(xs + error_shape.x() - 1,
-                                                  ys + error_shape.y() - 1,
-                                                  z)),
-                                    delta_fi);
-                        }
+                        T const *a = in.ptr(xs + fx, ys);
+                        T const *w = filter.ptr(fx, 0);
+                        for (int i = 0; i < run; i++) { sum += a[i] * w[i]; }
                     }
+                    out(x, y, fi) = this->activation_.value(bias + sum);
                 }
             }
-}
+        }
 
-            array3d_t<T> delta_next(this->input_shape_, T(0));
+        // adds gradients of all filters for padded inputs and their deltas
+        // every row fx of every filter is a separate task so there is enough work for
+        // all threads even with few filters, each gradient element is written by one task
+        // and summed in the same order whatever the number of threads
+        void accumulate_nabla(std::vector<view3d_t<T const>> const &inputs, std::vector<view3d_t<T const>> const &deltas)
+        {
+            const size_t fsize = this->filters_count();
+            const int filter_x = this->filter_shape_.x();
+            const size_t work = deltas.size() * this->convolution_work();
 
-            // use 'full' convolution (http://www.johnloomis.org/ece563/notes/filter/conv/convolution.html)
-            // so we need to set appropriate padding
-            const int weight_pad_x = utils::get_left_padding(error_shape, filter_shape, stride.x());
-            const int weight_pad_y = utils::get_top_padding(error_shape, filter_shape, stride.y());
+            this->parallel_for_2d(parallel_op::convolution, work, fsize, filter_x, [&](size_t fi, size_t fx)
+            {
+                for (size_t n = 0; n < deltas.size(); n++) { accumulate_filter_row(inputs[n], deltas[n], fi, fx); }
+            });
+        }
 
-            // input gradient of next layer is scaled by weights gradient of this layer
-            // gradient for the next layer is delta(l) (*) rot180(w(l))
-            // so for delta we apply "full" convolution with filter
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = fsize / thread_count;
-            size_t sub = fsize % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (size_t fi = start; fi < end; fi++)
-            {
-                // each output layer was created using full input (*) filter
-                // so each delta (output error) layer will influence errors of whole input as well
-                for (int z = 0; z < input_shape.z(); z++)
+        // adds gradient of the row fx of filter fi (and of its bias for the first row)
+        void accumulate_filter_row(view3d_t<T const> const &in, view3d_t<T const> const &delta, int fi, int fx)
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            auto &filter_shape = this->filter_shape_;
+            // (y, z) plane of the window is contiguous in padded input and in the filter
+            const int run = filter_shape.y() * filter_shape.z();
+
+            // dC/dw = a(l-1) (x) delta(l): every output adds its window scaled by its delta,
+            // sums are added to nabla only at the end to not lose precision
+            std::vector<T> sums(run, T(0));
+            T bias = 0;
+            for (int ex = 0; ex < output_shape.x(); ex++)
+            {
+                const int xs = ex * this->stride_.x() + fx;
+                for (int ey = 0; ey < output_shape.y(); ey++)
                 {
-                    auto filter = this->filter_weights_[fi].slice(dim_type::Z, z, z);
+                    const T de = delta(ex, ey, fi);
+                    bias += de;
+                    T const *a = in.ptr(xs, ey * this->stride_.y());
+                    for (int i = 0; i < run; i++) { sums[i] += a[i] * de; }
+                }
+            }
 
-                    // result of the convolution of delta and filter will be input size
-                    for (int y = 0; y < input_shape.y(); y++)
-                    {
-                        int ys = y * stride.y() - weight_pad_y;
+            T *w = this->nabla_data(fi) + fx * run;
+            for (int i = 0; i < run; i++) { w[i] += sums[i]; }
+            // dC/db = delta(l)
+            if (fx == 0) { this->nabla_biases_(fi) += bias; }
+        }
 
-                        for (int x = 0; x < input_shape.x(); x++)
+        // adds contributions of all delta layers to the rows [x0, x1) of the gradient with regards to input
+        // (filters are added one after another so the result doesn't depend on the partitioning)
+        void accumulate_delta_next(array3d_t<T> const &delta, view3d_t<T> const &out, int x0, int x1)
+        {
+            auto &error_shape = delta.shape();
+            auto &filter_shape = this->filter_shape_, &input_shape = this->input_shape_;
+            auto &stride = this->stride_;
+            const int depth = input_shape.z();
+            const int pad_x = this->get_left_padding();
+            const int pad_y = this->get_top_padding();
+
+            const int fsize = this->filters_count();
+            view3d_t<T const> d = delta.view();
+            std::vector<view3d_t<T const>> filters;
+            filters.reserve(fsize);
+            for (int fi = 0; fi < fsize; fi++) { filters.push_back(this->filter_view(fi)); }
+
+            // input (x, y) was multiplied by filter (fx, fy) in every output (ex, ey) whose
+            // window covers it, i.e. ex * stride + fx == x + pad, so its error is
+            // the sum of deltas of these outputs scaled by the same weights
+            std::vector<T> sums(depth);
+            for (int x = x0; x < x1; x++)
+            {
+                const int xp = x + pad_x;
+                const int ex0 = (xp < filter_shape.x()) ? 0 : (xp - filter_shape.x()) / stride.x() + 1;
+                const int ex1 = std::min(error_shape.x(), xp / stride.x() + 1);
+
+                for (int y = 0; y < input_shape.y(); y++)
+                {
+                    const int yp = y + pad_y;
+                    const int ey0 = (yp < filter_shape.y()) ? 0 : (yp - filter_shape.y()) / stride.y() + 1;
+                    const int ey1 = std::min(error_shape.y(), yp / stride.y() + 1);
+
+                    std::fill(sums.begin(), sums.end(), T(0));
+                    for (int ex = ex0; ex < ex1; ex++)
+                    {
+                        const int fx = xp - ex * stride.x();
+                        for (int ey = ey0; ey < ey1; ey++)
                         {
-                            int xs = x * stride.x() - weight_pad_x;
-
-                            delta_next(x, y, z) +=
-                                dot<T>(
-                                    delta.slice(
-                                        index3d_t(xs, ys, fi),
-                                        index3d_t(xs + filter_shape.x() - 1,
-                                                  ys + filter_shape.y() - 1,
-                                                  fi)),
-                                    filter);
+                            const int fy = yp - ey * stride.y();
+                            T const *de = d.ptr(ex, ey);
+                            for (int fi = 0; fi < fsize; fi++)
+                            {
+                                const T dv = de[fi];
+                                T const *w = filters[fi].ptr(fx, fy);
+                                for (int z = 0; z < depth; z++) { sums[z] += dv * w[z]; }
+                            }
                         }
                     }
+
+                    T *o = out.ptr(x, y);
+                    for (int z = 0; z < depth; z++) { o[z] += sums[z]; }
                 }
             }
-}
-
-            return delta_next;
         }
     };
 
-    template <typename T>
-    class convolution_layer_2d_t : public convolution_layer_base_t<T>
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_2d_t : public convolution_layer_base_t<T, Activation>
     {
     public:
         // use same constructor
-        using convolution_layer_base_t<T>::convolution_layer_base_t;
+        using convolution_layer_base_t<T, Activation>::convolution_layer_base_t;
 
     public:
         virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
         {
             assert(input.shape() == this->input_shape_);
             this->input_ = std::move(input);
-            // Extracts image patches from the input to form a
-            //  [out_height * out_width, filter_height * filter_width * in_channels]
-            this->input_patches_ = input_patches();
-            auto &patches = this->input_patches_;
-            // flattens filters to 2d matrix of size [filters_number, filter_height * filter_width * in_channels]
-            auto filters = flat_filters();
-            // convert biases to 1 array of size [filters_number]
-            auto biases = flat_biases();
-
-            const shape3d_t output_shape = this->get_output_shape();
-            std::vector<T> result;
-            result.reserve(output_shape.capacity());
-
-            // number of patches is [out_height * out_width]
-            const size_t patches_size = patches.size();
-            int size = patches_size;
-            for (size_t i = 0; i < patches_size; i++) 
-            {
-                // result has size of [filters_number]
-                auto conv = dot21(filters, patches[i]);
-                assert(conv.shape() == shape3d_t(output_shape.z(), 1, 1));
-                conv.add(biases);
-                result.insert(result.end(), conv.data().begin(), conv.data().end());
+            const size_t patches_size = this->get_output_shape().x() * this->get_output_shape().y();
+            const size_t filter_size = this->filter_shape_.capacity();
+            if (columns_.shape() != shape3d_t(patches_size, filter_size, 1))
+            {
+                columns_ = array3d_t<T>(shape3d_t(patches_size, filter_size, 1), T(0));
             }
 
-            this->output_ = array3d_t<T>(output_shape, std::move(result));
-            return this->activator_.activate(this->output_);
+            // image patches of the input form one contiguous im2col matrix of
+            //  [out_height * out_width, filter_height * filter_width * in_channels]
+            auto padded = this->padded_input(this->input_);
+            this->parallel_for(parallel_op::elementwise, patches_size * filter_size, 0, this->get_output_shape().x(), [&](size_t x)
+            {
+                im2col_row(padded, x, columns_.raw() + x * this->get_output_shape().y() * filter_size);
+            });
+
+            this->output_ = array3d_t<T>(this->get_output_shape(), T(0));
+            convolve(columns_.raw(), patches_size, this->output_.raw());
+            return this->activation_.activate(this->output_);
         }
 
         virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
@@ -399,274 +568,273 @@ namespace yannpp
             // error shape was already transformed in the prev layer as delta(l+1)(*)rot180(w(l+1))
             assert(error.shape() == this->output_.shape());
             // gradients with regards to input of this layer
-            array3d_t<T> delta;
-            delta = this->activator_.derivative(this->output_);
-            delta.element_mul(error);
-
-            /*
-             * transposed input patches are of size
-             * [filter_height * filter_width * filter_channels, out_width * out_height]
-             * so if we convolve them with deltas of size [filters_count, out_width * out_height]
-             * result will be of [filter_width * filter_height * filter_channels, filters_count]
-             */
-            auto input_patches = input_patches_transpose();
-            // reshape [out_height, out_width, filters_count] errors into
-            // [filters_count, output_height * output_width] array
-            auto deltas = reshape_deltas(delta);
-
-            const size_t deltas_size = deltas.size();
-            assert(deltas_size == this->nabla_weights_.size());
-            const size_t patches_size = input_patches.size();
-            // this is a workaround for the fact that array3d cannot be used
-            // for dot product of 4d arrays
-            // so do dot products of each row separately
-            
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = deltas_size / thread_count;
-            size_t sub = deltas_size % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (size_t d = start; d < end; d++)
-            {
-                std::vector<T> nabla_w;
-                nabla_w.reserve(this->filter_shape_.capacity());
-                for (size_t p = 0; p < patches_size; p++)
-                {
-                    nabla_w.push_back(inner_product(deltas[d], input_patches[p]));
-                }
-                this->nabla_weights_[d].add(array3d_t<T>(this->filter_shape_, std::move(nabla_w)));
-                this->nabla_biases_[d](0) += deltas[d].sum();
-            }
-}
+            array3d_t<T> delta = this->activation_.delta(this->output_, std::move(error));
+            return backpropagate_columns(delta.raw());
+        }
 
-            // precreate placeholders for sum
-            std::vector<array3d_t<T>> delta_input_channel;
-            for (size_t z = 0; z < this->input_shape_.z(); z++)
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            const size_t batch_size = input.batch_size();
+            this->batch_inputs_ = input.samples();
+            const size_t patches_size = this->get_output_shape().x() * this->get_output_shape().y();
+            const size_t filter_size = this->filter_shape_.capacity();
+            if (batch_columns_.batch_size() != batch_size || batch_columns_.shape() != shape3d_t(patches_size, filter_size, 1))
             {
-                delta_input_channel.emplace_back(
-                    array3d_t<T>(
-                        shape3d_t(this->input_shape_.x() * this->input_shape_.y(), 1, 1), T(0)));
+                batch_columns_ = array4d_t<T>(batch_size, shape3d_t(patches_size, filter_size, 1), T(0));
             }
-            // extract patches for convolution from each layer of deltas (# of layers == # of filters)
-            // returns array [filters_count, input_width * input_height, filter_width * filter_height] of deltas
-            auto dpatches = delta_patches(delta);
-            shape3d_t filter_slice_shape(this->filter_shape_.x() * this->filter_shape_.y(), 1, 1);
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = deltas_size / thread_count;
-            size_t sub = deltas_size % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (size_t d = start; d < end; d++)
-            {
-                // delta patch has size [input_width * input_height, filter_width * filter_height]
-                auto &delta_patch = dpatches[d];
-
-                // each output layer was created using full input (*) filter
-                // so each delta (output error) layer will influence errors of whole input as well
-                for (size_t z = 0; z < this->input_shape_.z(); z++)
-                {
-                    auto filter_z = this->filter_weights_[d].extract(
-                        index3d_t(0, 0, z),
-                        index3d_t(this->filter_shape_.x() - 1,
-                                  this->filter_shape_.y() - 1,
-                                  z));
-                    // result of size [input_width * input_height] - errors scaled by weights
-                    auto delta_z = dot21(delta_patch,
-                                         array3d_t<T>(filter_slice_shape, std::move(filter_z)));
-                    delta_input_channel[z].add(delta_z);
-                }
+
+            std::vector<view3d_t<T const>> inputs = this->padded_batch_inputs();
+
+            // im2col matrices of samples follow each other so they form
+            // one [batch_size * out_height * out_width, filter_size] matrix
+            const size_t out_x = this->get_output_shape().x();
+            this->parallel_for_2d(parallel_op::elementwise, batch_size * patches_size * filter_size, batch_size, out_x, [&](size_t n, size_t x)
+            {
+                im2col_row(inputs[n], x, batch_columns_.sample(n) + x * this->get_output_shape().y() * filter_size);
+            });
+
+            array4d_t<T> result(batch_size, this->get_output_shape(), T(0));
+            convolve(batch_columns_.raw(), batch_size * patches_size, result.raw());
+
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            assert(error.shape() == this->batch_output_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = this->activation_.delta(this->batch_output_, std::move(error));
+            return backpropagate_batch_columns(delta.raw(), batch_size);
+        }
+
+    protected:
+        // weight gradients and gradient with regards to input from delta [out_height * out_width, filters_count]
+        // of the last input whose im2col matrix is in columns_
+        array3d_t<T> backpropagate_columns(T const *delta)
+        {
+            // delta of size [out_height * out_width, filters_count] has the same row order
+            // as the im2col matrix so weight gradients are a single gemm
+            const size_t patches_size = this->get_output_shape().x() * this->get_output_shape().y();
+            accumulate_nabla(delta, this->columns_.raw(), patches_size);
+
+            // gradient of the im2col matrix is delta * filters of size [out_height * out_width, filter_size]
+            // and col2im adds each of its rows back to the window the patch was copied from
+            const size_t filter_size = this->filter_shape_.capacity();
+            if (delta_columns_.shape() != shape3d_t(patches_size, filter_size, 1))
+            {
+                delta_columns_ = array3d_t<T>(shape3d_t(patches_size, filter_size, 1), T(0));
             }
-}
+            columns_gradient(delta, patches_size, delta_columns_.raw());
 
             array3d_t<T> delta_next(this->input_shape_, T(0));
-            // just transpose errors of size [channels, input_height * input_width]
-            // to proper 3d array [input_height, input_width, channels]
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = this->input_shape_.x() / thread_count;
-            size_t sub = this->input_shape_.x() % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (size_t x = start; x < end; x++)
-            {
-                for (size_t y = 0; y < this->input_shape_.y(); y++)
-                {
-                    for (size_t z = 0; z < this->input_shape_.z(); z++)
-                    {
-                        delta_next(x, y, z) = delta_input_channel[z](y * this->input_shape_.x() + x);
-                    }
-                }
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded)
+            {
+                if (padded_delta_.shape() != padded_shape) { padded_delta_ = array3d_t<T>(padded_shape, T(0)); }
+                else { std::fill(padded_delta_.raw(), padded_delta_.raw() + padded_delta_.size(), T(0)); }
             }
-}
+            view3d_t<T> out = padded ? padded_delta_.view() : delta_next.view();
 
+            this->parallel_for(parallel_op::elementwise, patches_size * filter_size, 0, padded_shape.x(), [&](size_t x)
+            {
+                col2im_row(delta_columns_.raw(), x, out);
+            });
+
+            if (padded) { this->copy_from_padded(padded_delta_.view(), delta_next.view()); }
             return delta_next;
         }
 
-    private:
-        array3d_t<T> flat_filters()
+        // same for the minibatch with im2col matrices in batch_columns_
+        array4d_t<T> backpropagate_batch_columns(T const *delta, size_t batch_size)
         {
-            const int fsize = this->filter_weights_.size();
-            const int flength = this->filter_shape_.capacity();
-            std::vector<T> filters_matrix;
-            filters_matrix.reserve(fsize * flength);
-            for (int fi = 0; fi < fsize; fi++)
+            // one gemm per sample keeps the same summation order as backpropagate()
+            const size_t patches_size = this->get_output_shape().x() * this->get_output_shape().y();
+            accumulate_nabla(delta, this->batch_columns_.raw(), patches_size, batch_size);
+
+            // rows of delta * filters depend only on the same row of delta
+            // so the whole minibatch is one gemm
+            const size_t filter_size = this->filter_shape_.capacity();
+            if (batch_delta_columns_.batch_size() != batch_size || batch_delta_columns_.shape() != shape3d_t(patches_size, filter_size, 1))
             {
-                auto &data = this->filter_weights_[fi].data();
-                filters_matrix.insert(filters_matrix.end(), data.begin(), data.end());
+                batch_delta_columns_ = array4d_t<T>(batch_size, shape3d_t(patches_size, filter_size, 1), T(0));
             }
-            return array3d_t<T>(shape3d_t(fsize, flength, 1), std::move(filters_matrix));
-        }
+            columns_gradient(delta, batch_size * patches_size, batch_delta_columns_.raw());
 
-        std::deque<array3d_t<T>> input_patches()
-        {
-            std::deque<array3d_t<T>> patches;
-            const shape3d_t output_shape = this->get_output_shape();
-            auto &filter_shape = this->filter_shape_;
-
-            const int pad_x = this->get_left_padding();
-            const int pad_y = this->get_top_padding();
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded)
+            {
+                if (batch_padded_delta_.batch_size() != batch_size || batch_padded_delta_.shape() != padded_shape)
+                {
+                    batch_padded_delta_ = array4d_t<T>(batch_size, padded_shape, T(0));
+                }
+                else
+                {
+                    std::fill(batch_padded_delta_.raw(), batch_padded_delta_.raw() + batch_padded_delta_.size(), T(0));
+                }
+            }
 
-            for (int x = 0; x < output_shape.x(); x++)
+            this->parallel_for_2d(parallel_op::elementwise, batch_size * patches_size * filter_size, batch_size, padded_shape.x(), [&](size_t n, size_t x)
             {
-                int xs = x * this->stride_.x() - pad_x;
+                col2im_row(batch_delta_columns_.sample(n), x, padded ? batch_padded_delta_.view(n) : delta_next.view(n));
+            });
 
-                for (int y = 0; y < output_shape.y(); y++)
+            if (padded)
+            {
+                this->parallel_for(parallel_op::elementwise, batch_size * this->input_shape_.capacity(), 0, batch_size, [&](size_t n)
                 {
-                    int ys = y * this->stride_.y() - pad_y;
-
-                    patches.emplace_back(
-                        shape3d_t(filter_shape.capacity(), 1, 1),
-                        std::move(
-                            this->input_.extract(
-                                index3d_t(xs, ys, 0),
-                                index3d_t(xs + filter_shape.x() - 1,
-                                          ys + filter_shape.y() - 1,
-                                          this->input_shape_.z() - 1))));
-                }
+                    this->copy_from_padded(batch_padded_delta_.view(n), delta_next.view(n));
+                });
             }
 
-            return patches;
+            return delta_next;
         }
 
-        std::vector<array3d_t<T>> input_patches_transpose()
+    protected:
+        // output [patches_size, filters_count] = columns [patches_size, filter_size] * filters^T
+        // with bias and element-wise activation applied by the gemm epilogue
+        void convolve(T const *columns, size_t patches_size, T *output)
         {
-            assert(!this->input_patches_.empty());
-            std::vector<array3d_t<T>> patches;
+            const size_t filters_count = this->filters_count();
+            const size_t filter_size = this->filter_shape_.capacity();
+            T const *b = this->filter_biases_.raw();
+            auto const &activation = this->activation_;
+            auto epilogue = [b, &activation](size_t f, T v) { return activation.value(v + b[f]); };
+
+            gemm(transpose_type::no, transpose_type::yes,
+                 patches_size, filters_count, filter_size,
+                 T(1),
+                 columns, filter_size,
+                 this->filter_weights_.raw(), filter_size,
+                 T(0),
+                 output, filters_count,
+                 this->threads_for(parallel_op::gemm, patches_size * filters_count * filter_size),
+                 epilogue);
+        }
 
-            // flat size == filter_height * filter_width * in_channels
-            const int filter_flat_size = this->filter_shape_.capacity();
-            // patch size is equal to [out_width * out_height]
-            const size_t patches_size = this->input_patches_.size();
-            for (size_t i = 0; i < filter_flat_size; i++)
+        // nabla_w [filters_count, filter_size] += delta^T [filters_count, patches_size] * columns [patches_size, filter_size]
+        // nabla_b [filters_count] += column sums of delta
+        // for each of samples whose delta and im2col matrices follow each other
+        // gemm splits only [filters_count, filter_size] result between threads which is few blocks
+        // with few filters, so samples are single threaded gemms into own partial nabla instead
+        // and partials are added in sample order (same result as samples one after another)
+        void accumulate_nabla(T const *delta, T const *columns, size_t patches_size, size_t samples = 1)
+        {
+            const size_t filters_count = this->filters_count();
+            const size_t filter_size = this->filter_shape_.capacity();
+            const size_t work = samples * filters_count * filter_size * patches_size;
+            if (nabla_w_.shape() != shape3d_t(samples * filters_count, filter_size, 1))
             {
-                patches.emplace_back(shape3d_t(patches_size, 1, 1), T(0));
+                nabla_w_ = array3d_t<T>(shape3d_t(samples * filters_count, filter_size, 1), T(0));
             }
 
-            // input patches are of size
-            // [out_height * out_width, filter_height * filter_width * in_channels]
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = patches_size / thread_count;
-            size_t sub = patches_size % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (size_t i = start; i < end; i++)
-            {
-                auto &slice = this->input_patches_[i].data();
-                assert(slice.size() == filter_flat_size);
-                for (size_t j = 0; j < filter_flat_size; j++)
+            auto sample_nabla = [&](size_t n, int threads)
+            {
+                gemm(transpose_type::yes, transpose_type::no,
+                     filters_count, filter_size, patches_size,
+                     T(1),
+                     delta + n * patches_size * filters_count, filters_count,
+                     columns + n * patches_size * filter_size, filter_size,
+                     T(0),
+                     nabla_w_.raw() + n * filters_count * filter_size, filter_size,
+                     threads);
+            };
+            if (samples == 1) { sample_nabla(0, this->threads_for(parallel_op::gemm, work)); }
+            else { this->parallel_for(parallel_op::gemm, work, 0, samples, [&](size_t n) { sample_nabla(n, 1); }); }
+
+            this->parallel_for(parallel_op::elementwise, samples * filters_count * (filter_size + patches_size), 0, filters_count, [&](size_t f)
+            {
+                T *nabla_w = this->nabla_data(f);
+                for (size_t n = 0; n < samples; n++)
                 {
-                    patches[j](i) = slice[j];
-                }
-            }
-}
+                    T const *from = nabla_w_.raw() + (n * filters_count + f) * filter_size;
+                    for (size_t i = 0; i < filter_size; i++) { nabla_w[i] += from[i]; }
 
-            // this->input_patches_.clear();
-
-            return patches;
+                    T const *d = delta + n * patches_size * filters_count;
+                    T sum = 0;
+                    for (size_t p = 0; p < patches_size; p++) { sum += d[p * filters_count + f]; }
+                    this->nabla_biases_(f) += sum;
+                }
+            });
         }
 
-        std::vector<array3d_t<T>> delta_patches(array3d_t<T> const &delta)
+        // delta_columns [patches_size, filter_size] = delta [patches_size, filters_count] * filters
+        void columns_gradient(T const *delta, size_t patches_size, T *delta_columns)
         {
-            std::vector<array3d_t<T>> result;
-            auto &delta_shape = delta.shape();
-            auto &input_shape = this->input_shape_;
+            const size_t filters_count = this->filters_count();
+            const size_t filter_size = this->filter_shape_.capacity();
+
+            gemm(transpose_type::no, transpose_type::no,
+                 patches_size, filter_size, filters_count,
+                 T(1),
+                 delta, filters_count,
+                 this->filter_weights_.raw(), filter_size,
+                 T(0),
+                 delta_columns, filter_size,
+                 this->threads_for(parallel_op::gemm, patches_size * filter_size * filters_count));
+        }
 
-            const int weight_pad_x = utils::get_left_padding(delta_shape, this->filter_shape_, this->stride_.x());
-            const int weight_pad_y = utils::get_top_padding(delta_shape, this->filter_shape_, this->stride_.y());
+        // patches of the output row x as out_height rows of im2col matrix starting at row,
+        // each is a copy of filter_x contiguous runs of the padded input
+        void im2col_row(view3d_t<T const> const &input, size_t x, T *row) const
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            auto &filter_shape = this->filter_shape_;
+            const size_t filter_size = filter_shape.capacity();
+            const size_t run = (size_t)filter_shape.y() * filter_shape.z();
+            const int xs = (int)x * this->stride_.x();
 
-            const size_t filters_count = delta_shape.z();
-            result.reserve(filters_count);
-            
-            for (size_t di = 0; di < filters_count; di++)
+            for (int y = 0; y < output_shape.y(); y++)
             {
-                std::vector<T> patches;
-                patches.reserve(this->filter_shape_.capacity() * input_shape.x() * input_shape.y());
-                // result of the convolution of delta and filter will be input size
-                for (int y = 0; y < input_shape.y(); y++)
+                const int ys = y * this->stride_.y();
+                T *patch = row + y * filter_size;
+                for (int fx = 0; fx < filter_shape.x(); fx++)
                 {
-                    int ys = y * this->stride_.y() - weight_pad_y;
-
-                    for (int x = 0; x < input_shape.x(); x++)
-                    {
-                        int xs = x * this->stride_.x() - weight_pad_x;
-
-                        auto slice = delta.extract(
-                            index3d_t(xs, ys, di),
-                            index3d_t(xs + this->filter_shape_.x() - 1,
-                                      ys + this->filter_shape_.y() - 1,
-                                      di));
-
-                        patches.insert(patches.end(), slice.begin(), slice.end());
-                    }
+                    T const *from = input.ptr(xs + fx, ys);
+                    std::copy(from, from + run, patch + fx * run);
                 }
-                result.emplace_back(
-                    shape3d_t(input_shape.x() * input_shape.y(),
-                              this->filter_shape_.x() * this->filter_shape_.y(),
-                              1),
-                    std::move(patches));
             }
-
-            return result;
         }
 
-        array3d_t<T> flat_biases() { return unvectorize(this->filter_biases_); }
-        array3d_t<T> flat_nabla_b() { return unvectorize(this->nabla_biases_); }
-
-        std::vector<array3d_t<T>> reshape_deltas(array3d_t<T> const &delta)
+        // adds rows of the im2col gradient to row x of the padded input gradient
+        // only windows that cover row x are read so rows can be processed in parallel
+        void col2im_row(T const *delta_columns, size_t x, view3d_t<T> const &padded) const
         {
-            std::vector<array3d_t<T>> deltas;
-            auto &delta_shape = delta.shape();
-            deltas.reserve(delta_shape.z());
+            const shape3d_t output_shape = this->get_output_shape();
+            auto &filter_shape = this->filter_shape_;
+            const size_t filter_size = filter_shape.capacity();
+            const size_t run = (size_t)filter_shape.y() * filter_shape.z();
+            const int stride_x = this->stride_.x();
 
-            const int delta_WxH = delta_shape.x() * delta_shape.y();
-            const int zn = delta.shape().z();
+            // output rows ox with ox * stride_x <= x < ox * stride_x + filter_x
+            const int ox_first = ((int)x < filter_shape.x()) ? 0 : ((int)x - filter_shape.x()) / stride_x + 1;
+            const int ox_last = std::min(output_shape.x() - 1, (int)x / stride_x);
 
-            for (int z = 0; z < zn; z++)
+            for (int ox = ox_first; ox <= ox_last; ox++)
             {
-                deltas.emplace_back(shape3d_t(delta_WxH, 1, 1),
-                                    delta.extract(
-                                        index3d_t(0, 0, z),
-                                        index3d_t(delta_shape.x() - 1,
-                                                  delta_shape.y() - 1,
-                                                  z)));
+                const int fx = (int)x - ox * stride_x;
+                for (int oy = 0; oy < output_shape.y(); oy++)
+                {
+                    T const *from = delta_columns + (ox * output_shape.y() + oy) * filter_size + fx * run;
+                    T *to = padded.ptr(x, oy * this->stride_.y());
+                    for (size_t i = 0; i < run; i++) { to[i] += from[i]; }
+                }
             }
-
-            return deltas;
         }
 
-    private:
-        std::deque<array3d_t<T>> input_patches_;
+    protected:
+        // im2col matrices of the last input and minibatch
+        array3d_t<T> columns_;
+        array4d_t<T> batch_columns_;
+        // partial weight gradients of samples as [samples * filters_count, filter_size] matrix
+        array3d_t<T> nabla_w_;
+        // gradients of the im2col matrices and of the padded inputs
+        array3d_t<T> delta_columns_, padded_delta_;
+        array4d_t<T> batch_delta_columns_, batch_padded_delta_;
     };
 }
 
@@ -0,0 +1,312 @@
+#ifndef CONVOLUTIONLAYER_AUTO_H
+#define CONVOLUTIONLAYER_AUTO_H
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/execution_context.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/common/tuning_cache.h>
+#include <yannpp/layers/convolutionlayer.h>
+#include <yannpp/layers/convolutionlayer_blocked.h>
+#include <yannpp/layers/convolutionlayer_fft.h>
+#include <yannpp/layers/convolutionlayer_winograd.h>
+
+namespace yannpp
+{
+    // implementations of the same convolution with different performance
+    enum struct convolution_algorithm
+    {
+        loop,       // convolution_layer_loop_t
+        matrix,     // convolution_layer_2d_t
+        winograd_2, // convolution_layer_winograd_t with F(2x2, 3x3)
+        winograd_4, // convolution_layer_winograd_t with F(4x4, 3x3)
+        fft,        // convolution_layer_fft_t
+        blocked     // convolution_layer_blocked_t
+    };
+
+    enum { convolution_algorithms_count = 6 };
+
+    inline char const *convolution_algorithm_name(convolution_algorithm algorithm)
+    {
+        static char const *names[convolution_algorithms_count] = {"loop", "matrix", "winograd_2", "winograd_4", "fft", "blocked"};
+        return names[(int)algorithm];
+    }
+
+    inline bool parse_convolution_algorithm(std::string const &name, convolution_algorithm &algorithm)
+    {
+        for (int i = 0; i < convolution_algorithms_count; i++)
+        {
+            if (name == convolution_algorithm_name((convolution_algorithm)i))
+            {
+                algorithm = (convolution_algorithm)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename T, typename Activation = activator_t<T>>
+    std::unique_ptr<convolution_layer_base_t<T, Activation>> make_convolution_layer(convolution_algorithm algorithm,
+                                                                                    shape3d_t const &input_shape,
+                                                                                    shape3d_t const &filter_shape,
+                                                                                    int filters_number,
+                                                                                    int stride_length,
+                                                                                    padding_type padding,
+                                                                                    typename layer_activation_t<T, Activation>::argument_type const &activation,
+                                                                                    layer_metadata_t const &metadata = {})
+    {
+        using layer_ptr = std::unique_ptr<convolution_layer_base_t<T, Activation>>;
+        switch (algorithm)
+        {
+        case convolution_algorithm::matrix:
+            return layer_ptr(new convolution_layer_2d_t<T, Activation>(input_shape, filter_shape, filters_number, stride_length, padding, activation, metadata));
+        case convolution_algorithm::winograd_2:
+            return layer_ptr(new convolution_layer_winograd_t<T, Activation, 2>(input_shape, filter_shape, filters_number, stride_length, padding, activation, metadata));
+        case convolution_algorithm::winograd_4:
+            return layer_ptr(new convolution_layer_winograd_t<T, Activation, 4>(input_shape, filter_shape, filters_number, stride_length, padding, activation, metadata));
+        case convolution_algorithm::fft:
+            return layer_ptr(new convolution_layer_fft_t<T, Activation>(input_shape, filter_shape, filters_number, stride_length, padding, activation, metadata));
+        case convolution_algorithm::blocked:
+            return layer_ptr(new convolution_layer_blocked_t<T, Activation>(input_shape, filter_shape, filters_number, stride_length, padding, activation, metadata));
+        case convolution_algorithm::loop:
+        default:
+            return layer_ptr(new convolution_layer_loop_t<T, Activation>(input_shape, filter_shape, filters_number, stride_length, padding, activation, metadata));
+        }
+    }
+
+    // convolution that picks the fastest algorithm and number of threads for its shape in init()
+    // every applicable algorithm is timed on a constant minibatch with loaded constant weights
+    // (forward and backward) so that tuning doesn't generate random numbers
+    // and the choice is stored in tuning_cache_t keyed by shape, threads of the context and cpu model
+    // so later runs only read it; all other calls are forwarded to the chosen layer
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_auto_t : public layer_base_t<T>
+    {
+    private:
+        using layer_type = convolution_layer_base_t<T, Activation>;
+        using argument_type = typename layer_activation_t<T, Activation>::argument_type;
+
+    public:
+        // number of samples and timed runs of the benchmark
+        enum { tuning_batch_size = 8, tuning_runs = 3 };
+
+        convolution_layer_auto_t(shape3d_t const &input_shape,
+                                 shape3d_t const &filter_shape,
+                                 int filters_number,
+                                 int stride_length,
+                                 padding_type padding,
+                                 argument_type const &activation = argument_type(),
+                                 layer_metadata_t const &metadata = {}) : layer_base_t<T>(metadata),
+                                                                          input_shape_(input_shape),
+                                                                          filter_shape_(filter_shape),
+                                                                          filters_number_(filters_number),
+                                                                          stride_(stride_length),
+                                                                          padding_(padding),
+                                                                          activation_(activation),
+                                                                          algorithm_(convolution_algorithm::loop),
+                                                                          threads_(1)
+        {
+            assert(filter_shape.z() == input_shape.z());
+        }
+
+    public:
+        virtual void init() override
+        {
+            if (!layer_)
+            {
+                tune();
+                // chosen layer runs with tuned number of threads and same thresholds
+                context_ = this->get_execution_context();
+                context_.set_threads(threads_);
+                layer_ = make_convolution_layer<T, Activation>(algorithm_, input_shape_, filter_shape_, filters_number_,
+                                                               stride_, padding_, activation_, this->get_metadata());
+                layer_->set_execution_context(context_);
+                if (!weights_.empty()) { layer_->load(std::move(weights_), std::move(biases_)); }
+            }
+            layer_->init();
+        }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            assert(layer_);
+            return layer_->feedforward(std::move(input));
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
+        {
+            assert(layer_);
+            return layer_->backpropagate(std::move(error));
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(layer_);
+            return layer_->feedforward_batch(std::move(input));
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            assert(layer_);
+            return layer_->backpropagate_batch(std::move(error));
+        }
+
+        virtual void optimize(optimizer_t<T> const &strategy) override
+        {
+            assert(layer_);
+            layer_->optimize(strategy);
+        }
+
+        // weights loaded before init() are passed to the chosen layer
+        virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) override
+        {
+            if (layer_) { layer_->load(std::move(weights), std::move(biases)); }
+            else
+            {
+                weights_ = std::move(weights);
+                biases_ = std::move(biases);
+            }
+        }
+
+    public:
+        // valid after init()
+        inline convolution_algorithm algorithm() const { return algorithm_; }
+        inline int threads() const { return threads_; }
+        shape3d_t get_output_shape() const
+        {
+            assert(layer_);
+            return layer_->get_output_shape();
+        }
+
+    private:
+        std::string tuning_key() const
+        {
+            std::ostringstream key;
+            key << "convolution:" << cpu_model_name()
+                << ":" << sizeof(T)
+                << ":" << input_shape_.x() << "x" << input_shape_.y() << "x" << input_shape_.z()
+                << ":" << filter_shape_.x() << "x" << filter_shape_.y() << "x" << filters_number_
+                << ":" << stride_
+                << ":" << (padding_ == padding_type::valid ? "valid" : "same")
+                << ":" << this->get_execution_context().threads();
+            return key.str();
+        }
+
+        void tune()
+        {
+            const std::string key = tuning_key();
+            tuning_cache_t cache;
+            std::string value;
+            if (cache.find(key, value))
+            {
+                std::istringstream fields(value);
+                std::string name;
+                if (fields >> name >> threads_ && parse_convolution_algorithm(name, algorithm_) && threads_ > 0) { return; }
+            }
+
+            benchmark();
+            std::ostringstream result;
+            result << convolution_algorithm_name(algorithm_) << " " << threads_;
+            cache.store(key, result.str());
+        }
+
+        // winograd is for 3x3 filters only and fft needs stride 1, otherwise they fall back to loop
+        std::vector<convolution_algorithm> candidates() const
+        {
+            std::vector<convolution_algorithm> algorithms = {convolution_algorithm::loop,
+                                                             convolution_algorithm::matrix,
+                                                             convolution_algorithm::blocked};
+            if (stride_ == 1)
+            {
+                algorithms.push_back(convolution_algorithm::fft);
+                if (filter_shape_.x() == 3 && filter_shape_.y() == 3)
+                {
+                    algorithms.push_back(convolution_algorithm::winograd_2);
+                    algorithms.push_back(convolution_algorithm::winograd_4);
+                }
+            }
+            return algorithms;
+        }
+
+        // 1, 2, 4, ... and all threads of the context
+        std::vector<int> thread_counts() const
+        {
+            const int max_threads = this->get_execution_context().threads();
+            std::vector<int> counts;
+            for (int t = 1; t < max_threads; t *= 2) { counts.push_back(t); }
+            counts.push_back(max_threads);
+            return counts;
+        }
+
+        void benchmark()
+        {
+            // timings don't depend on the values
+            array4d_t<T> input(tuning_batch_size, input_shape_, T(1));
+
+            double best = std::numeric_limits<double>::max();
+            for (auto algorithm: candidates())
+            {
+                for (int threads: thread_counts())
+                {
+                    execution_context_t context(this->get_execution_context());
+                    context.set_threads(threads);
+                    auto layer = make_convolution_layer<T, Activation>(algorithm, input_shape_, filter_shape_, filters_number_,
+                                                                       stride_, padding_, activation_);
+                    layer->set_execution_context(context);
+                    // init() doesn't draw random weights for loaded ones
+                    std::vector<array3d_t<T>> weights, biases;
+                    for (int f = 0; f < filters_number_; f++)
+                    {
+                        weights.emplace_back(filter_shape_, T(1) / T(filter_shape_.capacity()));
+                        biases.emplace_back(shape_row(1), T(0));
+                    }
+                    layer->load(std::move(weights), std::move(biases));
+                    layer->init();
+
+                    // first run is a warm-up (buffers, cached filters)
+                    double time = std::numeric_limits<double>::max();
+                    for (int run = 0; run <= tuning_runs; run++)
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        auto output = layer->feedforward_batch(input.clone());
+                        layer->backpropagate_batch(std::move(output));
+                        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                        if (run > 0) { time = std::min(time, elapsed.count()); }
+                    }
+
+                    if (time < best)
+                    {
+                        best = time;
+                        algorithm_ = algorithm;
+                        threads_ = threads;
+                    }
+                }
+            }
+        }
+
+    private:
+        shape3d_t input_shape_;
+        shape3d_t filter_shape_;
+        int filters_number_;
+        int stride_;
+        padding_type padding_;
+        // chosen layer keeps reference to runtime activator so it's owned here
+        argument_type activation_;
+        convolution_algorithm algorithm_;
+        int threads_;
+        execution_context_t context_;
+        std::unique_ptr<layer_type> layer_;
+        // weights loaded before the layer was chosen
+        std::vector<array3d_t<T>> weights_, biases_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_AUTO_H
@@ -0,0 +1,201 @@
+#ifndef CONVOLUTIONLAYER_BLOCKED_H
+#define CONVOLUTIONLAYER_BLOCKED_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/layers/convolutionlayer.h>
+
+namespace yannpp
+{
+    // output channels computed together by one vector of accumulators
+    // and output positions along y sharing the same weights
+    template <typename T>
+    struct channel_blocking_t
+    {
+        enum { channels = 8, positions = 4 };
+    };
+
+    template <>
+    struct channel_blocking_t<float>
+    {
+        enum { channels = 16, positions = 4 };
+    };
+
+    // direct convolution with filters in channel-blocked layout
+    // [filters / block][filter_x][filter_y][depth][block] so that the innermost loop
+    // is a vector multiply-add of one input value with weights of a block of output channels
+    // input already has channels innermost and every block of output channels is a contiguous
+    // part of output (x, y) so only filters are converted (once, until the weights change)
+    // gradients are computed by convolution_layer_loop_t
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_blocked_t : public convolution_layer_loop_t<T, Activation>
+    {
+    private:
+        using loop_type = convolution_layer_loop_t<T, Activation>;
+        enum { block = channel_blocking_t<T>::channels, positions = channel_blocking_t<T>::positions };
+
+    public:
+        // use same constructor
+        using convolution_layer_loop_t<T, Activation>::convolution_layer_loop_t;
+
+    public:
+        virtual void init() override
+        {
+            loop_type::init();
+            filters_valid_ = false;
+        }
+
+        virtual void optimize(optimizer_t<T> const &strategy) override
+        {
+            loop_type::optimize(strategy);
+            filters_valid_ = false;
+        }
+
+        virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) override
+        {
+            loop_type::load(std::move(weights), std::move(biases));
+            filters_valid_ = false;
+        }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            this->input_ = std::move(input);
+            prepare_filters();
+
+            const shape3d_t output_shape = this->get_output_shape();
+            array3d_t<T> result(output_shape, T(0));
+            view3d_t<T const> in = this->padded_input(this->input_);
+            view3d_t<T> out = result.view();
+            this->parallel_for_2d(parallel_op::convolution, this->convolution_work(), output_shape.x(), blocks(),
+                                  [&](size_t x, size_t b) { convolve_row(in, x, b, out); });
+
+            this->output_ = std::move(result);
+            return this->activation_.activate(this->output_);
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            this->batch_inputs_ = input.samples();
+            const size_t batch_size = input.batch_size();
+            prepare_filters();
+
+            std::vector<view3d_t<T const>> padded = this->padded_batch_inputs();
+
+            const shape3d_t output_shape = this->get_output_shape();
+            array4d_t<T> result(batch_size, output_shape, T(0));
+            const size_t rows = output_shape.x() * blocks();
+            this->parallel_for_2d(parallel_op::convolution, batch_size * this->convolution_work(), batch_size, rows,
+                                  [&](size_t n, size_t i) { convolve_row(padded[n], i / blocks(), i % blocks(), result.view(n)); });
+
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+    private:
+        inline size_t blocks() const { return (this->filters_count() + block - 1) / block; }
+
+        // filters and biases in blocked layout, missing filters of the last block are zeros
+        void prepare_filters()
+        {
+            if (filters_valid_) { return; }
+
+            const size_t fsize = this->filters_count();
+            const size_t flength = this->filter_shape_.capacity();
+            blocked_filters_.assign(blocks() * flength * block, T(0));
+            blocked_biases_.assign(blocks() * block, T(0));
+
+            for (size_t f = 0; f < fsize; f++)
+            {
+                T *to = &blocked_filters_[(f / block) * flength * block + f % block];
+                T const *from = this->filter_data(f);
+                for (size_t i = 0; i < flength; i++) { to[i * block] = from[i]; }
+                blocked_biases_[f] = this->filter_biases_(f);
+            }
+
+            filters_valid_ = true;
+        }
+
+        // output row x for channels of block b
+        void convolve_row(view3d_t<T const> const &in, size_t x, size_t b, view3d_t<T> const &out)
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            const int depth = this->filter_shape_.z();
+            // window row (y, z) is contiguous in the input and so is the filter row in the block
+            const int run = this->filter_shape_.y() * depth;
+            const int step = this->stride_.y() * depth;
+            const int xs = (int)x * this->stride_.x();
+            const size_t fsize = this->filters_count();
+            const size_t channels = std::min<size_t>(block, fsize - b * block);
+            T const *filters = &blocked_filters_[b * this->filter_shape_.capacity() * block];
+            T const *biases = &blocked_biases_[b * block];
+
+            int y = 0;
+            for (; y + positions <= output_shape.y(); y += positions)
+            {
+                T acc[positions][block];
+                for (int p = 0; p < positions; p++)
+                {
+                    for (int c = 0; c < block; c++) { acc[p][c] = biases[c]; }
+                }
+
+                for (int fx = 0; fx < this->filter_shape_.x(); fx++)
+                {
+                    T const *a = in.ptr(xs + fx, y * this->stride_.y());
+                    T const *w = filters + fx * run * block;
+                    for (int i = 0; i < run; i++)
+                    {
+                        T const *wi = w + i * block;
+                        for (int p = 0; p < positions; p++)
+                        {
+                            const T ap = a[p * step + i];
+#   pragma omp simd
+                            for (int c = 0; c < block; c++) { acc[p][c] += ap * wi[c]; }
+                        }
+                    }
+                }
+
+                for (int p = 0; p < positions; p++)
+                {
+                    T *o = out.ptr(x, y + p) + b * block;
+                    for (size_t c = 0; c < channels; c++) { o[c] = this->activation_.value(acc[p][c]); }
+                }
+            }
+
+            // the rest of the row one position at a time
+            for (; y < output_shape.y(); y++)
+            {
+                T acc[block];
+                for (int c = 0; c < block; c++) { acc[c] = biases[c]; }
+
+                for (int fx = 0; fx < this->filter_shape_.x(); fx++)
+                {
+                    T const *a = in.ptr(xs + fx, y * this->stride_.y());
+                    T const *w = filters + fx * run * block;
+                    for (int i = 0; i < run; i++)
+                    {
+                        const T ai = a[i];
+                        T const *wi = w + i * block;
+#   pragma omp simd
+                        for (int c = 0; c < block; c++) { acc[c] += ai * wi[c]; }
+                    }
+                }
+
+                T *o = out.ptr(x, y) + b * block;
+                for (size_t c = 0; c < channels; c++) { o[c] = this->activation_.value(acc[c]); }
+            }
+        }
+
+    private:
+        bool filters_valid_ = false;
+        std::vector<T> blocked_filters_, blocked_biases_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_BLOCKED_H
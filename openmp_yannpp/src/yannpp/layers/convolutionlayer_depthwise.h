@@ -0,0 +1,292 @@
+#ifndef CONVOLUTIONLAYER_DEPTHWISE_H
+#define CONVOLUTIONLAYER_DEPTHWISE_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/layers/convolutionlayer.h>
+
+namespace yannpp
+{
+    // depthwise convolution: every input channel is convolved with own filter_size x filter_size filter
+    // so output has the same number of channels as input
+    // filter c (and its bias) is row c of the weights block of shape (filter_size, filter_size, 1)
+    // channels are innermost in input and output so every kernel is a vector operation over all channels
+    // with filters packed as [filter_x][filter_y][channel]
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_depthwise_t : public convolution_layer_base_t<T, Activation>
+    {
+    private:
+        using base_type = convolution_layer_base_t<T, Activation>;
+
+    public:
+        convolution_layer_depthwise_t(shape3d_t const &input_shape,
+                                      int filter_size,
+                                      int stride_length,
+                                      padding_type padding,
+                                      typename base_type::activation_type::argument_type const &activation = typename base_type::activation_type::argument_type(),
+                                      layer_metadata_t const &metadata = {}) : base_type(input_shape,
+                                                                                         shape3d_t(filter_size, filter_size, input_shape.z()),
+                                                                                         /*filters_number*/ input_shape.z(),
+                                                                                         stride_length,
+                                                                                         padding,
+                                                                                         activation,
+                                                                                         metadata)
+        {
+            // base checks filters against full input depth, each filter here sees one channel
+            this->filter_shape_ = shape3d_t(filter_size, filter_size, 1);
+        }
+
+    public:
+        virtual void init() override
+        {
+            base_type::init();
+            filters_valid_ = false;
+        }
+
+        virtual void optimize(optimizer_t<T> const &strategy) override
+        {
+            base_type::optimize(strategy);
+            filters_valid_ = false;
+        }
+
+        virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) override
+        {
+            base_type::load(std::move(weights), std::move(biases));
+            filters_valid_ = false;
+        }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            this->input_ = std::move(input);
+            prepare_filters();
+
+            const shape3d_t output_shape = this->get_output_shape();
+            array3d_t<T> result(output_shape, T(0));
+            view3d_t<T const> in = this->padded_input(this->input_);
+            view3d_t<T> out = result.view();
+            this->parallel_for(parallel_op::convolution, this->convolution_work(), 0, output_shape.x(),
+                               [&](size_t x) { convolve_row(in, x, out); });
+
+            this->output_ = std::move(result);
+            return this->activation_.activate(this->output_);
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
+        {
+            assert(error.shape() == this->output_.shape());
+            array3d_t<T> delta = this->activation_.delta(this->output_, std::move(error));
+            prepare_filters();
+
+            // padded buffer of the forward pass still holds the input
+            std::vector<view3d_t<T const>> padded(1, this->padded_input(this->input_));
+            std::vector<view3d_t<T const>> deltas(1, delta.view());
+            accumulate_nabla(padded, deltas);
+
+            const shape3d_t padded_shape = this->get_padded_shape();
+            if (padded_delta_.shape() != padded_shape) { padded_delta_ = array3d_t<T>(padded_shape, T(0)); }
+            else { padded_delta_.reset(T(0)); }
+
+            view3d_t<T> gradient = padded_delta_.view();
+            this->parallel_for(parallel_op::convolution, this->convolution_work(), 0, padded_shape.x(),
+                               [&](size_t x) { delta_row(deltas[0], x, gradient); });
+
+            array3d_t<T> delta_next(this->input_shape_, T(0));
+            this->copy_from_padded(padded_delta_.view(), delta_next.view());
+            return delta_next;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            this->batch_inputs_ = input.samples();
+            const size_t batch_size = input.batch_size();
+            prepare_filters();
+
+            std::vector<view3d_t<T const>> padded = this->padded_batch_inputs();
+            const shape3d_t output_shape = this->get_output_shape();
+            array4d_t<T> result(batch_size, output_shape, T(0));
+            this->parallel_for_2d(parallel_op::convolution, batch_size * this->convolution_work(), batch_size, output_shape.x(),
+                                  [&](size_t n, size_t x) { convolve_row(padded[n], x, result.view(n)); });
+
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            assert(error.shape() == this->batch_output_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = this->activation_.delta(this->batch_output_, std::move(error));
+            prepare_filters();
+
+            std::vector<view3d_t<T const>> padded = this->padded_batch_inputs();
+            std::vector<view3d_t<T const>> deltas;
+            for (size_t n = 0; n < batch_size; n++) { deltas.push_back(delta.view(n)); }
+            accumulate_nabla(padded, deltas);
+
+            const shape3d_t padded_shape = this->get_padded_shape();
+            if (batch_padded_delta_.batch_size() != batch_size || batch_padded_delta_.shape() != padded_shape)
+            {
+                batch_padded_delta_ = array4d_t<T>(batch_size, padded_shape, T(0));
+            }
+            else { batch_padded_delta_.reset(T(0)); }
+
+            const size_t work = batch_size * this->convolution_work();
+            this->parallel_for_2d(parallel_op::convolution, work, batch_size, padded_shape.x(),
+                                  [&](size_t n, size_t x) { delta_row(deltas[n], x, batch_padded_delta_.view(n)); });
+
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            this->parallel_for(parallel_op::elementwise, batch_size * this->input_shape_.capacity(), 0, batch_size, [&](size_t n)
+            {
+                this->copy_from_padded(batch_padded_delta_.view(n), delta_next.view(n));
+            });
+            return delta_next;
+        }
+
+    private:
+        inline int depth() const { return this->input_shape_.z(); }
+
+        // filters packed so that all channels of one filter position are contiguous
+        void prepare_filters()
+        {
+            if (filters_valid_) { return; }
+
+            const int channels = depth();
+            const int window = this->filter_shape_.x() * this->filter_shape_.y();
+            filters_.resize((size_t)window * channels);
+            for (int c = 0; c < channels; c++)
+            {
+                T const *from = this->filter_data(c);
+                for (int i = 0; i < window; i++) { filters_[(size_t)i * channels + c] = from[i]; }
+            }
+
+            filters_valid_ = true;
+        }
+
+        // output row x, every output (x, y) is accumulated in place over the window
+        void convolve_row(view3d_t<T const> const &in, size_t x, view3d_t<T> const &out) const
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            const int channels = depth();
+            const int fw = this->filter_shape_.x(), fh = this->filter_shape_.y();
+            const int xs = (int)x * this->stride_.x();
+            T const *biases = this->filter_biases_.raw();
+
+            for (int y = 0; y < output_shape.y(); y++)
+            {
+                const int ys = y * this->stride_.y();
+                T *o = out.ptr(x, y);
+                std::copy(biases, biases + channels, o);
+
+                for (int fx = 0; fx < fw; fx++)
+                {
+                    for (int fy = 0; fy < fh; fy++)
+                    {
+                        T const *a = in.ptr(xs + fx, ys + fy);
+                        T const *w = &filters_[(size_t)(fx * fh + fy) * channels];
+#   pragma omp simd
+                        for (int c = 0; c < channels; c++) { o[c] += a[c] * w[c]; }
+                    }
+                }
+
+                for (int c = 0; c < channels; c++) { o[c] = this->activation_.value(o[c]); }
+            }
+        }
+
+        // nabla of filter position (fx, fy) for all channels is a sum over all outputs of all samples
+        // so positions are independent and are computed in parallel
+        void accumulate_nabla(std::vector<view3d_t<T const>> const &padded, std::vector<view3d_t<T const>> const &deltas)
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            const int channels = depth();
+            const int fw = this->filter_shape_.x(), fh = this->filter_shape_.y();
+            const size_t count = deltas.size();
+            nabla_w_.assign((size_t)fw * fh * channels, T(0));
+
+            this->parallel_for(parallel_op::convolution, count * this->convolution_work(), 0, fw * fh, [&](size_t i)
+            {
+                const int fx = i / fh, fy = i % fh;
+                T *nabla = &nabla_w_[i * channels];
+                for (size_t n = 0; n < count; n++)
+                {
+                    for (int ex = 0; ex < output_shape.x(); ex++)
+                    {
+                        for (int ey = 0; ey < output_shape.y(); ey++)
+                        {
+                            T const *a = padded[n].ptr(ex * this->stride_.x() + fx, ey * this->stride_.y() + fy);
+                            T const *d = deltas[n].ptr(ex, ey);
+#   pragma omp simd
+                            for (int c = 0; c < channels; c++) { nabla[c] += a[c] * d[c]; }
+                        }
+                    }
+                }
+            });
+
+            // dC/db = sum of delta(l) over all outputs
+            std::vector<T> nabla_b(channels, T(0));
+            for (size_t n = 0; n < count; n++)
+            {
+                for (int ex = 0; ex < output_shape.x(); ex++)
+                {
+                    for (int ey = 0; ey < output_shape.y(); ey++)
+                    {
+                        T const *d = deltas[n].ptr(ex, ey);
+                        for (int c = 0; c < channels; c++) { nabla_b[c] += d[c]; }
+                    }
+                }
+            }
+
+            const int window = fw * fh;
+            for (int c = 0; c < channels; c++)
+            {
+                T *nabla = this->nabla_data(c);
+                for (int i = 0; i < window; i++) { nabla[i] += nabla_w_[(size_t)i * channels + c]; }
+                this->nabla_biases_(c) += nabla_b[c];
+            }
+        }
+
+        // adds deltas of all outputs whose windows cover the padded row xp
+        // (ex * stride + fx == xp) scaled by the same weights
+        void delta_row(view3d_t<T const> const &delta, size_t xp, view3d_t<T> const &gradient) const
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            const int channels = depth();
+            const int fw = this->filter_shape_.x(), fh = this->filter_shape_.y();
+            const int sx = this->stride_.x(), sy = this->stride_.y();
+            const int ex0 = ((int)xp < fw) ? 0 : ((int)xp - fw) / sx + 1;
+            const int ex1 = std::min(output_shape.x(), (int)xp / sx + 1);
+
+            for (int ex = ex0; ex < ex1; ex++)
+            {
+                const int fx = (int)xp - ex * sx;
+                for (int ey = 0; ey < output_shape.y(); ey++)
+                {
+                    T const *d = delta.ptr(ex, ey);
+                    for (int fy = 0; fy < fh; fy++)
+                    {
+                        T *g = gradient.ptr(xp, ey * sy + fy);
+                        T const *w = &filters_[(size_t)(fx * fh + fy) * channels];
+#   pragma omp simd
+                        for (int c = 0; c < channels; c++) { g[c] += d[c] * w[c]; }
+                    }
+                }
+            }
+        }
+
+    private:
+        bool filters_valid_ = false;
+        std::vector<T> filters_;
+        std::vector<T> nabla_w_;
+        // gradient with regards to the padded input
+        array3d_t<T> padded_delta_;
+        array4d_t<T> batch_padded_delta_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_DEPTHWISE_H
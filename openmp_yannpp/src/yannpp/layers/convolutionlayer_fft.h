@@ -0,0 +1,323 @@
+#ifndef CONVOLUTIONLAYER_FFT_H
+#define CONVOLUTIONLAYER_FFT_H
+
+#include <algorithm>
+#include <cassert>
+#include <complex>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/fft.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/common/thread_scratch.h>
+#include <yannpp/layers/convolutionlayer.h>
+
+namespace yannpp
+{
+    // convolution in frequency domain for stride 1, cost doesn't depend on the filter size
+    // so it pays off for large filters and feature maps
+    // planes are padded to n1 x n2 >= padded input (only 2, 3, 5 factors) so that
+    // circular correlation has no wrap-around in the part that is used:
+    //   output(f) = ifft(Sum_c in(c) * conj(w(f, c)))
+    //   nabla_w(f, c) = ifft(Sum_n in(n, c) * conj(delta(n, f)))
+    //   delta_next(c) = ifft(Sum_f delta(f) * w(f, c))
+    // filter spectra are cached until the weights change, spectra of the inputs are kept
+    // for the weight gradients (separately for single samples and minibatches)
+    // other strides are computed by convolution_layer_loop_t
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_fft_t : public convolution_layer_loop_t<T, Activation>
+    {
+    private:
+        using loop_type = convolution_layer_loop_t<T, Activation>;
+        using complex_type = std::complex<T>;
+
+    public:
+        // use same constructor
+        using convolution_layer_loop_t<T, Activation>::convolution_layer_loop_t;
+
+    public:
+        virtual void init() override
+        {
+            loop_type::init();
+            filters_valid_ = false;
+        }
+
+        virtual void optimize(optimizer_t<T> const &strategy) override
+        {
+            loop_type::optimize(strategy);
+            filters_valid_ = false;
+        }
+
+        virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) override
+        {
+            loop_type::load(std::move(weights), std::move(biases));
+            filters_valid_ = false;
+        }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            if (!is_supported()) { return loop_type::feedforward(std::move(input)); }
+            assert(input.shape() == this->input_shape_);
+
+            this->input_ = std::move(input);
+            array3d_t<T> result(this->get_output_shape(), T(0));
+            std::vector<view3d_t<T const>> inputs(1, this->padded_input(this->input_));
+            std::vector<view3d_t<T>> outputs(1, result.view());
+            convolve(inputs, outputs, input_spectra_);
+
+            this->output_ = std::move(result);
+            return this->activation_.activate(this->output_);
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
+        {
+            if (!is_supported()) { return loop_type::backpropagate(std::move(error)); }
+            assert(error.shape() == this->output_.shape());
+            array3d_t<T> delta = this->activation_.delta(this->output_, std::move(error));
+
+            array3d_t<T> delta_next(this->input_shape_, T(0));
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded && padded_gradient_.shape() != padded_shape) { padded_gradient_ = array3d_t<T>(padded_shape, T(0)); }
+
+            std::vector<view3d_t<T const>> deltas(1, delta.view());
+            std::vector<view3d_t<T>> gradients(1, padded ? padded_gradient_.view() : delta_next.view());
+            backward(deltas, gradients, input_spectra_);
+
+            if (padded) { this->copy_from_padded(padded_gradient_.view(), delta_next.view()); }
+            return delta_next;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            if (!is_supported()) { return loop_type::feedforward_batch(std::move(input)); }
+            assert(input.shape() == this->input_shape_);
+
+            this->batch_inputs_ = input.samples();
+            const size_t batch_size = input.batch_size();
+
+            std::vector<view3d_t<T const>> inputs = this->padded_batch_inputs();
+
+            array4d_t<T> result(batch_size, this->get_output_shape(), T(0));
+            std::vector<view3d_t<T>> outputs;
+            for (size_t n = 0; n < batch_size; n++) { outputs.push_back(result.view(n)); }
+            convolve(inputs, outputs, batch_input_spectra_);
+
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            if (!is_supported()) { return loop_type::backpropagate_batch(std::move(error)); }
+            assert(error.shape() == this->batch_output_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = this->activation_.delta(this->batch_output_, std::move(error));
+
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded && (batch_padded_gradient_.batch_size() != batch_size || batch_padded_gradient_.shape() != padded_shape))
+            {
+                batch_padded_gradient_ = array4d_t<T>(batch_size, padded_shape, T(0));
+            }
+
+            std::vector<view3d_t<T const>> deltas;
+            std::vector<view3d_t<T>> gradients;
+            for (size_t n = 0; n < batch_size; n++)
+            {
+                deltas.push_back(delta.view(n));
+                gradients.push_back(padded ? batch_padded_gradient_.view(n) : delta_next.view(n));
+            }
+            backward(deltas, gradients, batch_input_spectra_);
+
+            if (padded)
+            {
+                this->parallel_for(parallel_op::elementwise, batch_size * this->input_shape_.capacity(), 0, batch_size, [&](size_t n)
+                {
+                    this->copy_from_padded(batch_padded_gradient_.view(n), delta_next.view(n));
+                });
+            }
+            return delta_next;
+        }
+
+    private:
+        bool is_supported() const { return this->stride_.x() == 1 && this->stride_.y() == 1; }
+
+        // plan for the padded input, per-thread scratch and spectra of the filters
+        void prepare()
+        {
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const size_t n1 = fft_good_size(padded_shape.x()), n2 = fft_good_size(padded_shape.y());
+            if (fft_.n1() != n1 || fft_.n2() != n2)
+            {
+                fft_ = fft2d_real_t<T>(n1, n2);
+                filters_valid_ = false;
+            }
+
+            // summed spectrum followed by the workspace of the transforms
+            work_.prepare(this->get_execution_context(), fft_.spectrum_size() + fft_.workspace_size());
+            nabla_.prepare(this->get_execution_context(), this->filter_shape_.x() * this->filter_shape_.y());
+            if (filters_valid_) { return; }
+
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+            const size_t spectrum = fft_.spectrum_size();
+            auto &filter_shape = this->filter_shape_;
+            filter_spectra_.resize(fsize * depth * spectrum);
+
+            this->parallel_for_2d(parallel_op::elementwise, fsize * depth * spectrum, fsize, depth, [&](size_t f, size_t c)
+            {
+                fft_.forward(this->filter_data(f) + c,
+                             filter_shape.x(), filter_shape.y(), filter_shape.y() * depth, depth,
+                             &filter_spectra_[(f * depth + c) * spectrum], work_.data());
+            });
+
+            filters_valid_ = true;
+        }
+
+        // spectra of the inputs are stored to input_spectra
+        void convolve(std::vector<view3d_t<T const>> const &inputs, std::vector<view3d_t<T>> const &outputs,
+                      std::vector<complex_type> &input_spectra)
+        {
+            prepare();
+            const size_t count = inputs.size();
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+            const size_t spectrum = fft_.spectrum_size();
+            const shape3d_t padded_shape = inputs[0].shape();
+            const shape3d_t output_shape = this->get_output_shape();
+
+            input_spectra.resize(count * depth * spectrum);
+            product_spectra_.resize(count * fsize * spectrum);
+
+            this->parallel_for_2d(parallel_op::elementwise, count * depth * spectrum, count, depth, [&](size_t n, size_t c)
+            {
+                fft_.forward(inputs[n].ptr(0, 0) + c,
+                             padded_shape.x(), padded_shape.y(), padded_shape.y() * depth, depth,
+                             &input_spectra[(n * depth + c) * spectrum], work_.data());
+            });
+
+            // correlation is product with conjugated filter spectrum summed over channels
+            this->parallel_for_2d(parallel_op::elementwise, count * fsize * depth * spectrum, count, fsize, [&](size_t n, size_t f)
+            {
+                complex_type *out = &product_spectra_[(n * fsize + f) * spectrum];
+                std::fill(out, out + spectrum, complex_type(0));
+                for (size_t c = 0; c < depth; c++)
+                {
+                    complex_type const *in = &input_spectra[(n * depth + c) * spectrum];
+                    complex_type const *w = &filter_spectra_[(f * depth + c) * spectrum];
+                    for (size_t s = 0; s < spectrum; s++) { out[s] += complex_mul(in[s], std::conj(w[s])); }
+                }
+            });
+
+            this->parallel_for_2d(parallel_op::elementwise, count * fsize * spectrum, count, fsize, [&](size_t n, size_t f)
+            {
+                view3d_t<T> const &out = outputs[n];
+                fft_.inverse(&product_spectra_[(n * fsize + f) * spectrum],
+                             output_shape.x(), output_shape.y(), output_shape.y() * fsize, fsize,
+                             out.ptr(0, 0) + f, work_.data());
+
+                const T bias = this->filter_biases_(f);
+                for (int x = 0; x < output_shape.x(); x++)
+                {
+                    for (int y = 0; y < output_shape.y(); y++)
+                    {
+                        T &o = out(x, y, f);
+                        o = this->activation_.value(o + bias);
+                    }
+                }
+            });
+        }
+
+        // accumulates nabla of weights and biases and writes gradients of the padded inputs
+        // input_spectra are the ones stored by convolve() for the same samples
+        void backward(std::vector<view3d_t<T const>> const &deltas, std::vector<view3d_t<T>> const &gradients,
+                      std::vector<complex_type> const &input_spectra)
+        {
+            prepare();
+            const size_t count = deltas.size();
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+            const size_t spectrum = fft_.spectrum_size();
+            const shape3d_t output_shape = this->get_output_shape();
+            const shape3d_t padded_shape = this->get_padded_shape();
+            auto &filter_shape = this->filter_shape_;
+            assert(input_spectra.size() == count * depth * spectrum);
+
+            delta_spectra_.resize(count * fsize * spectrum);
+            this->parallel_for_2d(parallel_op::elementwise, count * fsize * spectrum, count, fsize, [&](size_t n, size_t f)
+            {
+                fft_.forward(deltas[n].ptr(0, 0) + f,
+                             output_shape.x(), output_shape.y(), output_shape.y() * fsize, fsize,
+                             &delta_spectra_[(n * fsize + f) * spectrum], work_.data());
+            });
+
+            this->parallel_for(parallel_op::elementwise, count * deltas[0].shape().capacity(), 0, fsize, [&](size_t f)
+            {
+                T sum = 0;
+                for (size_t n = 0; n < count; n++)
+                {
+                    for (int x = 0; x < output_shape.x(); x++)
+                    {
+                        for (int y = 0; y < output_shape.y(); y++) { sum += deltas[n](x, y, f); }
+                    }
+                }
+                this->nabla_biases_(f) += sum;
+            });
+
+            // gradients of the whole minibatch are summed in frequency domain
+            this->parallel_for_2d(parallel_op::elementwise, count * fsize * depth * spectrum, fsize, depth, [&](size_t f, size_t c)
+            {
+                complex_type *product = work_.data();
+                std::fill(product, product + spectrum, complex_type(0));
+                for (size_t n = 0; n < count; n++)
+                {
+                    complex_type const *in = &input_spectra[(n * depth + c) * spectrum];
+                    complex_type const *d = &delta_spectra_[(n * fsize + f) * spectrum];
+                    for (size_t s = 0; s < spectrum; s++) { product[s] += complex_mul(in[s], std::conj(d[s])); }
+                }
+
+                T *nabla = nabla_.data();
+                fft_.inverse(product, filter_shape.x(), filter_shape.y(), filter_shape.y(), 1, nabla, product + spectrum);
+
+                view3d_t<T> nabla_w(this->nabla_data(f), filter_shape);
+                for (int x = 0; x < filter_shape.x(); x++)
+                {
+                    for (int y = 0; y < filter_shape.y(); y++) { nabla_w(x, y, c) += nabla[x * filter_shape.y() + y]; }
+                }
+            });
+
+            // delta_next is a (not circular) convolution of delta with filters
+            this->parallel_for_2d(parallel_op::elementwise, count * fsize * depth * spectrum, count, depth, [&](size_t n, size_t c)
+            {
+                complex_type *product = work_.data();
+                std::fill(product, product + spectrum, complex_type(0));
+                for (size_t f = 0; f < fsize; f++)
+                {
+                    complex_type const *d = &delta_spectra_[(n * fsize + f) * spectrum];
+                    complex_type const *w = &filter_spectra_[(f * depth + c) * spectrum];
+                    for (size_t s = 0; s < spectrum; s++) { product[s] += complex_mul(d[s], w[s]); }
+                }
+
+                fft_.inverse(product,
+                             padded_shape.x(), padded_shape.y(), padded_shape.y() * depth, depth,
+                             gradients[n].ptr(0, 0) + c, product + spectrum);
+            });
+        }
+
+    private:
+        bool filters_valid_ = false;
+        fft2d_real_t<T> fft_;
+        // [filters, depth], [samples, depth] and [samples, filters] spectra
+        std::vector<complex_type> filter_spectra_, input_spectra_, batch_input_spectra_, delta_spectra_, product_spectra_;
+        // per-thread summed spectrum with fft workspace and filter plane of nabla
+        thread_scratch_t<complex_type> work_;
+        thread_scratch_t<T> nabla_;
+        array3d_t<T> padded_gradient_;
+        array4d_t<T> batch_padded_gradient_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_FFT_H
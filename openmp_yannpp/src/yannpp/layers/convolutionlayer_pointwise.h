@@ -0,0 +1,154 @@
+#ifndef CONVOLUTIONLAYER_POINTWISE_H
+#define CONVOLUTIONLAYER_POINTWISE_H
+
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/gemm.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/layers/convolutionlayer.h>
+
+namespace yannpp
+{
+    // 1x1 convolution: input with channels innermost already is [positions, channels] matrix
+    // and weights block is [filters_count, channels] matrix
+    // so forward and both gradients are single gemm calls without any patch extraction
+    // (samples of the minibatch are contiguous so the whole minibatch is one matrix as well)
+    template <typename T, typename Activation = activator_t<T>>
+    class convolution_layer_pointwise_t : public convolution_layer_base_t<T, Activation>
+    {
+    private:
+        using base_type = convolution_layer_base_t<T, Activation>;
+
+    public:
+        convolution_layer_pointwise_t(shape3d_t const &input_shape,
+                                      int filters_number,
+                                      typename base_type::activation_type::argument_type const &activation = typename base_type::activation_type::argument_type(),
+                                      layer_metadata_t const &metadata = {}) : base_type(input_shape,
+                                                                                         shape3d_t(1, 1, input_shape.z()),
+                                                                                         filters_number,
+                                                                                         1,
+                                                                                         padding_type::valid,
+                                                                                         activation,
+                                                                                         metadata)
+        { }
+
+    public:
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            this->input_ = std::move(input);
+            array3d_t<T> result(this->get_output_shape(), T(0));
+            convolve(this->input_.raw(), positions(), result.raw());
+            this->output_ = std::move(result);
+            return this->activation_.activate(this->output_);
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
+        {
+            assert(error.shape() == this->output_.shape());
+            array3d_t<T> delta = this->activation_.delta(this->output_, std::move(error));
+            accumulate_nabla(delta.raw(), this->input_.raw(), positions());
+
+            array3d_t<T> delta_next(this->input_shape_, T(0));
+            input_gradient(delta.raw(), positions(), delta_next.raw());
+            return delta_next;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            const size_t batch_size = input.batch_size();
+            batch_input_ = std::move(input);
+            array4d_t<T> result(batch_size, this->get_output_shape(), T(0));
+            convolve(batch_input_.raw(), batch_size * positions(), result.raw());
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            assert(error.shape() == this->batch_output_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = this->activation_.delta(this->batch_output_, std::move(error));
+            accumulate_nabla(delta.raw(), batch_input_.raw(), batch_size * positions());
+
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            input_gradient(delta.raw(), batch_size * positions(), delta_next.raw());
+            return delta_next;
+        }
+
+    private:
+        inline size_t positions() const { return (size_t)this->input_shape_.x() * this->input_shape_.y(); }
+
+        // output [rows, filters_count] = input [rows, depth] * filters^T
+        // with bias and activation applied by the gemm epilogue
+        void convolve(T const *input, size_t rows, T *output)
+        {
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+            T const *b = this->filter_biases_.raw();
+            auto const &activation = this->activation_;
+            auto epilogue = [b, &activation](size_t f, T v) { return activation.value(v + b[f]); };
+
+            gemm(transpose_type::no, transpose_type::yes,
+                 rows, fsize, depth,
+                 T(1),
+                 input, depth,
+                 this->filter_weights_.raw(), depth,
+                 T(0),
+                 output, fsize,
+                 this->threads_for(parallel_op::gemm, rows * fsize * depth),
+                 epilogue);
+        }
+
+        // nabla_w [filters_count, depth] += delta^T [filters_count, rows] * input [rows, depth]
+        // accumulated by the gemm directly in the weights gradient block
+        // nabla_b [filters_count] += column sums of delta
+        void accumulate_nabla(T const *delta, T const *input, size_t rows)
+        {
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+
+            gemm(transpose_type::yes, transpose_type::no,
+                 fsize, depth, rows,
+                 T(1),
+                 delta, fsize,
+                 input, depth,
+                 T(1),
+                 this->nabla_weights_.raw(), depth,
+                 this->threads_for(parallel_op::gemm, fsize * depth * rows));
+
+            this->parallel_for(parallel_op::elementwise, fsize * rows, 0, fsize, [&](size_t f)
+            {
+                T sum = 0;
+                for (size_t p = 0; p < rows; p++) { sum += delta[p * fsize + f]; }
+                this->nabla_biases_(f) += sum;
+            });
+        }
+
+        // delta_next [rows, depth] = delta [rows, filters_count] * filters
+        void input_gradient(T const *delta, size_t rows, T *delta_next)
+        {
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+
+            gemm(transpose_type::no, transpose_type::no,
+                 rows, depth, fsize,
+                 T(1),
+                 delta, fsize,
+                 this->filter_weights_.raw(), depth,
+                 T(0),
+                 delta_next, depth,
+                 this->threads_for(parallel_op::gemm, rows * depth * fsize));
+        }
+
+    private:
+        // minibatch is kept as one matrix instead of batch_inputs_ samples
+        array4d_t<T> batch_input_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_POINTWISE_H
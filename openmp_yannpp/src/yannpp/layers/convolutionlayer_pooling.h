@@ -0,0 +1,360 @@
+#ifndef CONVOLUTIONLAYER_POOLING_H
+#define CONVOLUTIONLAYER_POOLING_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/gemm.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/common/thread_scratch.h>
+#include <yannpp/layers/convolutionlayer.h>
+#include <yannpp/network/activation_policies.h>
+
+namespace yannpp
+{
+    // convolution_layer_2d_t with relu followed by 2x2 max pooling with stride 2 as one layer
+    // two convolution rows of one pooled row are computed as a small gemm in a local tile,
+    // bias and relu are applied by the gemm epilogue and the tile is max-pooled while in cache
+    // so only pooled output and argmax (wx * 2 + wy within the window, plus active_flag
+    // when the maximum passed relu) are written and the output is returned without a copy
+    // backward is fused the same way: error of a pooled row is expanded through argmax and
+    // relu derivative into the delta of its two convolution rows, im2col rows of the tile give
+    // their weight gradients (summed per thread) and delta * filters is added back to the input
+    // gradient, so neither the full im2col matrix nor the convolution delta is built
+    // tiles of rows px and px + phases() don't overlap in the input so those run in parallel
+    template <typename T>
+    class convolution_pooling_layer_t : public convolution_layer_2d_t<T, relu_activation_t>
+    {
+    private:
+        using base_type = convolution_layer_2d_t<T, relu_activation_t>;
+
+    public:
+        convolution_pooling_layer_t(shape3d_t const &input_shape,
+                                    shape3d_t const &filter_shape,
+                                    int filters_number,
+                                    int stride_length,
+                                    padding_type padding,
+                                    layer_metadata_t const &metadata = {}) : base_type(input_shape,
+                                                                                       filter_shape,
+                                                                                       filters_number,
+                                                                                       stride_length,
+                                                                                       padding,
+                                                                                       relu_activation_t(),
+                                                                                       metadata)
+        { }
+
+    public:
+        // bit of max index set when the pooled value is positive (relu derivative is 1)
+        enum { active_flag = 4 };
+
+        // shape of the output of the layer (get_output_shape() is the convolution result)
+        shape3d_t get_pooled_shape() const
+        {
+            const shape3d_t conv_shape = this->get_output_shape();
+            return shape3d_t(conv_shape.x() / 2, conv_shape.y() / 2, conv_shape.z());
+        }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            this->input_ = std::move(input);
+            const shape3d_t pooled_shape = get_pooled_shape();
+            array3d_t<T> result(pooled_shape, T(0));
+            if (max_index_.shape() != pooled_shape) { max_index_ = array3d_t<unsigned char>(pooled_shape, (unsigned char)0); }
+
+            prepare_tiles();
+
+            view3d_t<T const> in = this->padded_input(this->input_);
+            this->parallel_for(parallel_op::convolution, this->convolution_work(), 0, pooled_shape.x(), [&](size_t px)
+            {
+                pool_row(in, px, this->filter_weights_.raw(), this->filter_biases_.raw(), result.view(), max_index_.view());
+            });
+
+            return result;
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
+        {
+            assert(error.shape() == max_index_.shape());
+            prepare_tiles();
+            prepare_partials();
+
+            array3d_t<T> delta_next(this->input_shape_, T(0));
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded)
+            {
+                if (padded_gradient_.shape() != padded_shape) { padded_gradient_ = array3d_t<T>(padded_shape, T(0)); }
+                else { padded_gradient_.reset(T(0)); }
+            }
+            view3d_t<T> out = padded ? padded_gradient_.view() : delta_next.view();
+
+            view3d_t<T const> in = this->padded_input(this->input_);
+            const size_t pooled_x = error.shape().x(), phases = this->phases();
+            for (size_t phase = 0; phase < std::min(phases, pooled_x); phase++)
+            {
+                const size_t rows = (pooled_x - phase + phases - 1) / phases;
+                this->parallel_for(parallel_op::convolution, this->convolution_work(), 0, rows, [&](size_t i)
+                {
+                    unpool_row(in, error.view(), max_index_.view(), phase + i * phases, this->filter_weights_.raw(), out);
+                });
+            }
+            reduce_partials();
+
+            if (padded) { this->copy_from_padded(padded_gradient_.view(), delta_next.view()); }
+            return delta_next;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            assert(input.shape() == this->input_shape_);
+            const size_t batch_size = input.batch_size();
+            this->batch_inputs_ = input.samples();
+            const shape3d_t pooled_shape = get_pooled_shape();
+            array4d_t<T> result(batch_size, pooled_shape, T(0));
+            if (batch_max_index_.batch_size() != batch_size || batch_max_index_.shape() != pooled_shape)
+            {
+                batch_max_index_ = array4d_t<unsigned char>(batch_size, pooled_shape, (unsigned char)0);
+            }
+
+            prepare_tiles();
+
+            std::vector<view3d_t<T const>> inputs = this->padded_batch_inputs();
+            this->parallel_for_2d(parallel_op::convolution, batch_size * this->convolution_work(), batch_size, pooled_shape.x(), [&](size_t n, size_t px)
+            {
+                pool_row(inputs[n], px, this->filter_weights_.raw(), this->filter_biases_.raw(), result.view(n), batch_max_index_.view(n));
+            });
+
+            return result;
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            assert(error.shape() == batch_max_index_.shape());
+            const size_t batch_size = error.batch_size();
+            prepare_tiles();
+            prepare_partials();
+
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded)
+            {
+                if (batch_padded_gradient_.batch_size() != batch_size || batch_padded_gradient_.shape() != padded_shape)
+                {
+                    batch_padded_gradient_ = array4d_t<T>(batch_size, padded_shape, T(0));
+                }
+                else
+                {
+                    std::fill(batch_padded_gradient_.raw(), batch_padded_gradient_.raw() + batch_padded_gradient_.size(), T(0));
+                }
+            }
+
+            std::vector<view3d_t<T const>> inputs = this->padded_batch_inputs();
+            const size_t pooled_x = error.shape().x(), phases = this->phases();
+            for (size_t phase = 0; phase < std::min(phases, pooled_x); phase++)
+            {
+                const size_t rows = (pooled_x - phase + phases - 1) / phases;
+                this->parallel_for_2d(parallel_op::convolution, batch_size * this->convolution_work(), batch_size, rows, [&](size_t n, size_t i)
+                {
+                    unpool_row(inputs[n], error.view(n), batch_max_index_.view(n), phase + i * phases, this->filter_weights_.raw(),
+                               padded ? batch_padded_gradient_.view(n) : delta_next.view(n));
+                });
+            }
+            reduce_partials();
+
+            if (padded)
+            {
+                this->parallel_for(parallel_op::elementwise, batch_size * this->input_shape_.capacity(), 0, batch_size, [&](size_t n)
+                {
+                    this->copy_from_padded(batch_padded_gradient_.view(n), delta_next.view(n));
+                });
+            }
+            return delta_next;
+        }
+
+    private:
+        // tile of every thread: im2col rows of two convolution rows
+        // followed by their [2 * conv_y, filters_count] gemm result
+        void prepare_tiles()
+        {
+            const shape3d_t conv_shape = this->get_output_shape();
+            const size_t tile_size = 2 * conv_shape.y() * (this->filter_shape_.capacity() + conv_shape.z());
+            tiles_.prepare(this->get_execution_context(), tile_size);
+        }
+
+        // pooled row px reads and writes input rows [2 * px * stride_x, (2 * px + 1) * stride_x + filter_x)
+        // so rows that are phases() apart are independent
+        size_t phases() const
+        {
+            const size_t stride_x = this->stride_.x();
+            return (stride_x + this->filter_shape_.x() + 2 * stride_x - 1) / (2 * stride_x);
+        }
+
+        // zeroed [filters_count, filter_size] weight and [filters_count] bias gradients of every thread
+        void prepare_partials()
+        {
+            const size_t filters_count = this->filters_count();
+            partials_.prepare(this->get_execution_context(), filters_count * (this->filter_shape_.capacity() + 1));
+            for (size_t i = 0; i < partials_.slots(); i++)
+            {
+                std::fill(partials_.slot(i), partials_.slot(i) + partials_.size(), T(0));
+            }
+        }
+
+        void reduce_partials()
+        {
+            const size_t filters_count = this->filters_count();
+            const size_t filter_size = this->filter_shape_.capacity();
+            this->parallel_for(parallel_op::elementwise, partials_.slots() * partials_.size(), 0, filters_count, [&](size_t f)
+            {
+                T *nabla_w = this->nabla_data(f);
+                for (size_t i = 0; i < partials_.slots(); i++)
+                {
+                    T const *from = partials_.slot(i) + f * filter_size;
+                    for (size_t j = 0; j < filter_size; j++) { nabla_w[j] += from[j]; }
+                    this->nabla_biases_(f) += partials_.slot(i)[filters_count * filter_size + f];
+                }
+            });
+        }
+
+        // pooled row px from convolution rows 2 * px and 2 * px + 1
+        void pool_row(view3d_t<T const> const &in, size_t px, T const *filters, T const *biases,
+                      view3d_t<T> const &out, view3d_t<unsigned char> const &max_index)
+        {
+            const shape3d_t conv_shape = this->get_output_shape();
+            const size_t conv_y = conv_shape.y();
+            const size_t filters_count = conv_shape.z();
+            const size_t filter_size = this->filter_shape_.capacity();
+            const size_t tile_rows = 2 * conv_y;
+
+            T *columns = tiles_.data();
+            T *tile = columns + tile_rows * filter_size;
+            this->im2col_row(in, 2 * px, columns);
+            this->im2col_row(in, 2 * px + 1, columns + conv_y * filter_size);
+
+            auto const &activation = this->activation_;
+            auto epilogue = [biases, &activation](size_t f, T v) { return activation.value(v + biases[f]); };
+            // rows are already split between threads
+            gemm(transpose_type::no, transpose_type::yes,
+                 tile_rows, filters_count, filter_size,
+                 T(1),
+                 columns, filter_size,
+                 filters, filter_size,
+                 T(0),
+                 tile, filters_count,
+                 1,
+                 epilogue);
+
+            // same window order and tie breaking as pooling_layer_t
+            const int pooled_y = conv_shape.y() / 2;
+            for (int py = 0; py < pooled_y; py++)
+            {
+                T const *r00 = &tile[(2 * py) * filters_count];
+                T const *r01 = r00 + filters_count;
+                T const *r10 = r00 + conv_y * filters_count;
+                T const *r11 = r10 + filters_count;
+                T *o = out.ptr(px, py);
+                unsigned char *m = max_index.ptr(px, py);
+                for (size_t f = 0; f < filters_count; f++)
+                {
+                    T v = r00[f];
+                    unsigned char i = 0;
+                    if (r01[f] > v) { v = r01[f]; i = 1; }
+                    if (r10[f] > v) { v = r10[f]; i = 2; }
+                    if (r11[f] > v) { v = r11[f]; i = 3; }
+                    o[f] = v;
+                    m[f] = (v > T(0)) ? (i | active_flag) : i;
+                }
+            }
+        }
+
+        // backward of pooled row px: error times relu derivative goes to the argmax positions of
+        // the [2 * conv_y, filters_count] delta of its convolution rows (other positions are zero),
+        // weight gradients are added to partials of the thread and delta * filters to the input gradient
+        void unpool_row(view3d_t<T const> const &in, view3d_t<T const> const &error,
+                        view3d_t<unsigned char const> const &max_index, size_t px, T const *filters,
+                        view3d_t<T> const &gradient)
+        {
+            const shape3d_t conv_shape = this->get_output_shape();
+            const size_t conv_y = conv_shape.y();
+            const size_t filters_count = conv_shape.z();
+            const size_t filter_size = this->filter_shape_.capacity();
+            const size_t tile_rows = 2 * conv_y;
+
+            T *columns = tiles_.data();
+            T *delta = columns + tile_rows * filter_size;
+            T *nabla_w = partials_.data();
+            T *nabla_b = nabla_w + filters_count * filter_size;
+            this->im2col_row(in, 2 * px, columns);
+            this->im2col_row(in, 2 * px + 1, columns + conv_y * filter_size);
+
+            std::fill(delta, delta + tile_rows * filters_count, T(0));
+            for (int py = 0; py < error.shape().y(); py++)
+            {
+                T const *e = error.ptr(px, py);
+                unsigned char const *m = max_index.ptr(px, py);
+                for (size_t f = 0; f < filters_count; f++)
+                {
+                    if (!(m[f] & active_flag)) { continue; }
+                    const size_t row = ((m[f] >> 1) & 1) * conv_y + 2 * py + (m[f] & 1);
+                    delta[row * filters_count + f] = e[f];
+                    nabla_b[f] += e[f];
+                }
+            }
+
+            // rows are already split between threads
+            gemm(transpose_type::yes, transpose_type::no,
+                 filters_count, filter_size, tile_rows,
+                 T(1),
+                 delta, filters_count,
+                 columns, filter_size,
+                 T(1),
+                 nabla_w, filter_size,
+                 1);
+
+            // im2col rows are not needed anymore so their gradient takes their place
+            gemm(transpose_type::no, transpose_type::no,
+                 tile_rows, filter_size, filters_count,
+                 T(1),
+                 delta, filters_count,
+                 filters, filter_size,
+                 T(0),
+                 columns, filter_size,
+                 1);
+
+            // col2im of the two rows: every patch is added back to the window it was copied from
+            auto &filter_shape = this->filter_shape_;
+            const size_t run = (size_t)filter_shape.y() * filter_shape.z();
+            for (size_t r = 0; r < 2; r++)
+            {
+                const int xs = (int)(2 * px + r) * this->stride_.x();
+                for (size_t y = 0; y < conv_y; y++)
+                {
+                    T const *patch = columns + (r * conv_y + y) * filter_size;
+                    for (int fx = 0; fx < filter_shape.x(); fx++)
+                    {
+                        T const *from = patch + fx * run;
+                        T *to = gradient.ptr(xs + fx, (int)y * this->stride_.y());
+                        for (size_t i = 0; i < run; i++) { to[i] += from[i]; }
+                    }
+                }
+            }
+        }
+
+    private:
+        // argmax of every pooled output within its window
+        array3d_t<unsigned char> max_index_;
+        array4d_t<unsigned char> batch_max_index_;
+        // gradients of the padded inputs
+        array3d_t<T> padded_gradient_;
+        array4d_t<T> batch_padded_gradient_;
+        // per-thread tiles of pool_row() and unpool_row() and weight gradients of unpool_row()
+        thread_scratch_t<T> tiles_, partials_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_POOLING_H
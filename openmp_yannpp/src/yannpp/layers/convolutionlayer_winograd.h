@@ -0,0 +1,509 @@
+#ifndef CONVOLUTIONLAYER_WINOGRAD_H
+#define CONVOLUTIONLAYER_WINOGRAD_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/gemm.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/common/thread_scratch.h>
+#include <yannpp/layers/convolutionlayer.h>
+
+namespace yannpp
+{
+    // transform matrices of Winograd minimal filtering F(m x m, 3 x 3)
+    // for a tile d of alpha x alpha inputs and filter g the m x m output is
+    // Y = A^T [(G g G^T) [X] (B^T d B)] A (see Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks")
+    template <typename T, int M>
+    struct winograd_tile_t;
+
+    template <typename T>
+    struct winograd_tile_t<T, 2>
+    {
+        enum { m = 2, r = 3, alpha = 4 };
+
+        static T const *bt()
+        {
+            static const T v[alpha * alpha] = {
+                1,  0, -1,  0,
+                0,  1,  1,  0,
+                0, -1,  1,  0,
+                0,  1,  0, -1 };
+            return v;
+        }
+
+        static T const *g()
+        {
+            static const T v[alpha * r] = {
+                T(1),   T(0),    T(0),
+                T(0.5), T(0.5),  T(0.5),
+                T(0.5), T(-0.5), T(0.5),
+                T(0),   T(0),    T(1) };
+            return v;
+        }
+
+        static T const *at()
+        {
+            static const T v[m * alpha] = {
+                1, 1,  1,  0,
+                0, 1, -1, -1 };
+            return v;
+        }
+    };
+
+    template <typename T>
+    struct winograd_tile_t<T, 4>
+    {
+        enum { m = 4, r = 3, alpha = 6 };
+
+        static T const *bt()
+        {
+            static const T v[alpha * alpha] = {
+                4,  0, -5,  0, 1, 0,
+                0, -4, -4,  1, 1, 0,
+                0,  4, -4, -1, 1, 0,
+                0, -2, -1,  2, 1, 0,
+                0,  2, -1, -2, 1, 0,
+                0,  4,  0, -5, 0, 1 };
+            return v;
+        }
+
+        static T const *g()
+        {
+            static const T v[alpha * r] = {
+                T(1) / 4,   T(0),       T(0),
+                T(-1) / 6,  T(-1) / 6,  T(-1) / 6,
+                T(-1) / 6,  T(1) / 6,   T(-1) / 6,
+                T(1) / 24,  T(1) / 12,  T(1) / 6,
+                T(1) / 24,  T(-1) / 12, T(1) / 6,
+                T(0),       T(0),       T(1) };
+            return v;
+        }
+
+        static T const *at()
+        {
+            static const T v[m * alpha] = {
+                1, 1,  1, 1,  1, 0,
+                0, 1, -1, 2, -2, 0,
+                0, 1,  1, 4,  4, 0,
+                0, 1, -1, 8, -8, 1 };
+            return v;
+        }
+    };
+
+    // Winograd convolution for 3x3 filters with stride 1, TileSize is m of F(m x m, 3 x 3) (2 or 4)
+    // forward and gradient with regards to input (which is "full" convolution of delta
+    // with rotated filters, so it's computed by the same algorithm) use transformed filters
+    // cached until the weights change, gradients of weights are computed directly
+    // other filter sizes and strides are computed by convolution_layer_loop_t
+    template <typename T, typename Activation = activator_t<T>, int TileSize = 2>
+    class convolution_layer_winograd_t : public convolution_layer_loop_t<T, Activation>
+    {
+    private:
+        using tile_type = winograd_tile_t<T, TileSize>;
+        using loop_type = convolution_layer_loop_t<T, Activation>;
+        enum { m = tile_type::m, r = tile_type::r, alpha = tile_type::alpha, points = alpha * alpha };
+
+    public:
+        // use same constructor
+        using convolution_layer_loop_t<T, Activation>::convolution_layer_loop_t;
+
+    public:
+        virtual void init() override
+        {
+            loop_type::init();
+            filters_valid_ = false;
+        }
+
+        virtual void optimize(optimizer_t<T> const &strategy) override
+        {
+            loop_type::optimize(strategy);
+            filters_valid_ = false;
+        }
+
+        virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) override
+        {
+            loop_type::load(std::move(weights), std::move(biases));
+            filters_valid_ = false;
+        }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override
+        {
+            if (!is_supported()) { return loop_type::feedforward(std::move(input)); }
+            assert(input.shape() == this->input_shape_);
+
+            this->input_ = std::move(input);
+            prepare_filters();
+
+            array3d_t<T> result(this->get_output_shape(), T(0));
+            std::vector<view3d_t<T const>> inputs(1, this->padded_input(this->input_));
+            std::vector<view3d_t<T>> outputs(1, result.view());
+            convolve(inputs, outputs, forward_filters_.data(), bias_epilogue());
+
+            this->output_ = std::move(result);
+            return this->activation_.activate(this->output_);
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override
+        {
+            if (!is_supported()) { return loop_type::backpropagate(std::move(error)); }
+            assert(error.shape() == this->output_.shape());
+            array3d_t<T> delta = this->activation_.delta(this->output_, std::move(error));
+
+            std::vector<view3d_t<T const>> padded_inputs(1, this->padded_input(this->input_));
+            std::vector<view3d_t<T const>> deltas(1, delta.view());
+            this->accumulate_nabla(padded_inputs, deltas);
+
+            prepare_filters();
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (padded_delta_.shape() != delta_padded_shape()) { padded_delta_ = array3d_t<T>(delta_padded_shape(), T(0)); }
+            if (padded && padded_gradient_.shape() != padded_shape) { padded_gradient_ = array3d_t<T>(padded_shape, T(0)); }
+
+            copy_to_padded_delta(delta.view(), padded_delta_.view());
+            array3d_t<T> delta_next(this->input_shape_, T(0));
+            std::vector<view3d_t<T const>> inputs(1, padded_delta_.view());
+            std::vector<view3d_t<T>> outputs(1, padded ? padded_gradient_.view() : delta_next.view());
+            convolve(inputs, outputs, backward_filters_.data(), identity_epilogue_t());
+
+            if (padded) { this->copy_from_padded(padded_gradient_.view(), delta_next.view()); }
+            return delta_next;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override
+        {
+            if (!is_supported()) { return loop_type::feedforward_batch(std::move(input)); }
+            assert(input.shape() == this->input_shape_);
+
+            this->batch_inputs_ = input.samples();
+            const size_t batch_size = input.batch_size();
+            prepare_filters();
+
+            std::vector<view3d_t<T const>> inputs = this->padded_batch_inputs();
+
+            // tiles of all samples go to the same gemms
+            array4d_t<T> result(batch_size, this->get_output_shape(), T(0));
+            std::vector<view3d_t<T>> outputs;
+            for (size_t n = 0; n < batch_size; n++) { outputs.push_back(result.view(n)); }
+            convolve(inputs, outputs, forward_filters_.data(), bias_epilogue());
+
+            this->batch_output_ = std::move(result);
+            return this->activation_.activate(this->batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override
+        {
+            if (!is_supported()) { return loop_type::backpropagate_batch(std::move(error)); }
+            assert(error.shape() == this->batch_output_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = this->activation_.delta(this->batch_output_, std::move(error));
+            std::vector<view3d_t<T const>> deltas;
+            for (size_t n = 0; n < batch_size; n++) { deltas.push_back(delta.view(n)); }
+            this->accumulate_nabla(this->padded_batch_inputs(), deltas);
+
+            prepare_filters();
+            const shape3d_t padded_shape = this->get_padded_shape();
+            const bool padded = (padded_shape != this->input_shape_);
+            if (batch_padded_delta_.batch_size() != batch_size || batch_padded_delta_.shape() != delta_padded_shape())
+            {
+                batch_padded_delta_ = array4d_t<T>(batch_size, delta_padded_shape(), T(0));
+            }
+            if (padded && (batch_padded_gradient_.batch_size() != batch_size || batch_padded_gradient_.shape() != padded_shape))
+            {
+                batch_padded_gradient_ = array4d_t<T>(batch_size, padded_shape, T(0));
+            }
+
+            array4d_t<T> delta_next(batch_size, this->input_shape_, T(0));
+            std::vector<view3d_t<T const>> inputs;
+            std::vector<view3d_t<T>> outputs;
+            for (size_t n = 0; n < batch_size; n++)
+            {
+                copy_to_padded_delta(delta.view(n), batch_padded_delta_.view(n));
+                inputs.push_back(batch_padded_delta_.view(n));
+                outputs.push_back(padded ? batch_padded_gradient_.view(n) : delta_next.view(n));
+            }
+            convolve(inputs, outputs, backward_filters_.data(), identity_epilogue_t());
+
+            if (padded)
+            {
+                for (size_t n = 0; n < batch_size; n++) { this->copy_from_padded(batch_padded_gradient_.view(n), delta_next.view(n)); }
+            }
+            return delta_next;
+        }
+
+    private:
+        struct bias_epilogue_t
+        {
+            T const *biases;
+            layer_activation_t<T, Activation> const *activation;
+            inline T operator()(size_t f, T v) const { return activation->value(v + biases[f]); }
+        };
+
+    private:
+        bool is_supported() const
+        {
+            return this->stride_.x() == 1 && this->stride_.y() == 1 &&
+                   this->filter_shape_.x() == r && this->filter_shape_.y() == r;
+        }
+
+        // delta surrounded by r - 1 zeros, its convolution with rotated filters
+        // is the gradient of the padded input
+        shape3d_t delta_padded_shape() const
+        {
+            const shape3d_t output_shape = this->get_output_shape();
+            return shape3d_t(output_shape.x() + 2 * (r - 1), output_shape.y() + 2 * (r - 1), output_shape.z());
+        }
+
+        void copy_to_padded_delta(view3d_t<T const> const &delta, view3d_t<T> const &padded) const
+        {
+            const shape3d_t &shape = delta.shape();
+            const size_t run = (size_t)shape.y() * shape.z();
+            for (int x = 0; x < shape.x(); x++)
+            {
+                T const *from = delta.ptr(x, 0);
+                std::copy(from, from + run, padded.ptr(x + r - 1, r - 1));
+            }
+        }
+
+        // transformed filters are [points] matrices of [in_channels, out_channels]
+        // for the forward pass in_channels is input depth and out_channels is filters count
+        // and vice versa for the gradient with regards to input
+        void prepare_filters()
+        {
+            if (filters_valid_) { return; }
+
+            const size_t fsize = this->filters_count();
+            const size_t depth = this->input_shape_.z();
+            std::vector<view3d_t<T const>> filters;
+            for (size_t f = 0; f < fsize; f++) { filters.push_back(this->filter_view(f)); }
+
+            transform_filters(depth, fsize, [&](size_t c, size_t f, int kx, int ky)
+            {
+                return filters[f].ptr(kx, ky)[c];
+            }, forward_filters_);
+
+            transform_filters(fsize, depth, [&](size_t f, size_t c, int kx, int ky)
+            {
+                return filters[f].ptr(r - 1 - kx, r - 1 - ky)[c];
+            }, backward_filters_);
+
+            filters_valid_ = true;
+        }
+
+        // u = G g G^T for every pair of input and output channels
+        template <typename Weight>
+        void transform_filters(size_t in_channels, size_t out_channels, Weight const &weight, std::vector<T> &u)
+        {
+            const size_t size = in_channels * out_channels;
+            u.resize(points * size);
+            T const *g = tile_type::g();
+
+            this->parallel_for(parallel_op::elementwise, points * size, 0, out_channels, [&](size_t co)
+            {
+                for (size_t ci = 0; ci < in_channels; ci++)
+                {
+                    T t[alpha * r];
+                    for (int i = 0; i < alpha; i++)
+                    {
+                        for (int j = 0; j < r; j++)
+                        {
+                            T sum = 0;
+                            for (int k = 0; k < r; k++) { sum += g[i * r + k] * weight(ci, co, k, j); }
+                            t[i * r + j] = sum;
+                        }
+                    }
+
+                    for (int i = 0; i < alpha; i++)
+                    {
+                        for (int j = 0; j < alpha; j++)
+                        {
+                            T sum = 0;
+                            for (int k = 0; k < r; k++) { sum += t[i * r + k] * g[j * r + k]; }
+                            u[(i * alpha + j) * size + ci * out_channels + co] = sum;
+                        }
+                    }
+                }
+            });
+        }
+
+        // outputs(x, y, co) = epilogue(co, sum of inputs(x + kx, y + ky, ci) * g(ci, co, kx, ky))
+        // input tiles are transformed to [points] matrices of [tiles, in_channels],
+        // multiplied by the transformed filters with one gemm per point
+        // and transformed back to the output tiles
+        template <typename Epilogue>
+        void convolve(std::vector<view3d_t<T const>> const &inputs,
+                      std::vector<view3d_t<T>> const &outputs,
+                      T const *filters,
+                      Epilogue const &epilogue)
+        {
+            assert(inputs.size() == outputs.size());
+            const size_t count = inputs.size();
+            const shape3d_t output_shape = outputs[0].shape();
+            const size_t in_channels = inputs[0].shape().z();
+            const size_t out_channels = output_shape.z();
+            const size_t tiles_x = (output_shape.x() + m - 1) / m;
+            const size_t tiles_y = (output_shape.y() + m - 1) / m;
+            const size_t tiles = count * tiles_x * tiles_y;
+
+            transformed_input_.resize(points * tiles * in_channels);
+            transformed_output_.resize(points * tiles * out_channels);
+            // d and t of transform_input() or t and y of transform_output()
+            scratch_.prepare(this->get_execution_context(),
+                             std::max(2 * points * in_channels, (m * alpha + 1) * out_channels));
+
+            this->parallel_for_2d(parallel_op::elementwise, points * tiles * in_channels, count, tiles_x, [&](size_t n, size_t tx)
+            {
+                transform_input(inputs[n], tx, tiles_y, tiles * in_channels, (n * tiles_x + tx) * tiles_y);
+            });
+
+            // gemms are independent and small so each runs in one thread
+            this->parallel_for(parallel_op::gemm, points * tiles * in_channels * out_channels, 0, points, [&](size_t e)
+            {
+                gemm(transpose_type::no, transpose_type::no,
+                     tiles, out_channels, in_channels,
+                     T(1),
+                     transformed_input_.data() + e * tiles * in_channels, in_channels,
+                     filters + e * in_channels * out_channels, out_channels,
+                     T(0),
+                     transformed_output_.data() + e * tiles * out_channels, out_channels,
+                     1);
+            });
+
+            this->parallel_for_2d(parallel_op::elementwise, points * tiles * out_channels, count, tiles_x, [&](size_t n, size_t tx)
+            {
+                transform_output(outputs[n], tx, tiles_y, tiles * out_channels, (n * tiles_x + tx) * tiles_y, epilogue);
+            });
+        }
+
+        // v = B^T d B for the column tx of tiles, all channels at once
+        // (input values outside of the input are zeros)
+        void transform_input(view3d_t<T const> const &input, size_t tx, size_t tiles_y, size_t ld, size_t tile0)
+        {
+            const shape3d_t &shape = input.shape();
+            const size_t depth = shape.z();
+            T const *bt = tile_type::bt();
+            T *d = scratch_.data(), *t = d + points * depth;
+
+            for (size_t ty = 0; ty < tiles_y; ty++)
+            {
+                for (int i = 0; i < alpha; i++)
+                {
+                    for (int j = 0; j < alpha; j++)
+                    {
+                        const int x = (int)tx * m + i, y = (int)ty * m + j;
+                        T *di = &d[(i * alpha + j) * depth];
+                        if (x < shape.x() && y < shape.y()) { std::copy(input.ptr(x, y), input.ptr(x, y) + depth, di); }
+                        else { std::fill(di, di + depth, T(0)); }
+                    }
+                }
+
+                // t = B^T d
+                for (int i = 0; i < alpha; i++)
+                {
+                    for (int j = 0; j < alpha; j++)
+                    {
+                        T *ti = &t[(i * alpha + j) * depth];
+                        std::fill(ti, ti + depth, T(0));
+                        for (int k = 0; k < alpha; k++)
+                        {
+                            const T b = bt[i * alpha + k];
+                            if (b == T(0)) { continue; }
+                            T const *dk = &d[(k * alpha + j) * depth];
+                            for (size_t c = 0; c < depth; c++) { ti[c] += b * dk[c]; }
+                        }
+                    }
+                }
+
+                // v = t B
+                for (int i = 0; i < alpha; i++)
+                {
+                    for (int j = 0; j < alpha; j++)
+                    {
+                        T *v = transformed_input_.data() + (i * alpha + j) * ld + (tile0 + ty) * depth;
+                        std::fill(v, v + depth, T(0));
+                        for (int k = 0; k < alpha; k++)
+                        {
+                            const T b = bt[j * alpha + k];
+                            if (b == T(0)) { continue; }
+                            T const *tk = &t[(i * alpha + k) * depth];
+                            for (size_t c = 0; c < depth; c++) { v[c] += b * tk[c]; }
+                        }
+                    }
+                }
+            }
+        }
+
+        // y = A^T M A for the column tx of tiles, only part inside of the output is written
+        template <typename Epilogue>
+        void transform_output(view3d_t<T> const &output, size_t tx, size_t tiles_y, size_t ld, size_t tile0,
+                              Epilogue const &epilogue)
+        {
+            const shape3d_t &shape = output.shape();
+            const size_t depth = shape.z();
+            T const *at = tile_type::at();
+            T *t = scratch_.data(), *y = t + m * alpha * depth;
+
+            for (size_t ty = 0; ty < tiles_y; ty++)
+            {
+                // t = A^T M
+                for (int i = 0; i < m; i++)
+                {
+                    for (int j = 0; j < alpha; j++)
+                    {
+                        T *ti = &t[(i * alpha + j) * depth];
+                        std::fill(ti, ti + depth, T(0));
+                        for (int k = 0; k < alpha; k++)
+                        {
+                            const T a = at[i * alpha + k];
+                            if (a == T(0)) { continue; }
+                            T const *mk = transformed_output_.data() + (k * alpha + j) * ld + (tile0 + ty) * depth;
+                            for (size_t c = 0; c < depth; c++) { ti[c] += a * mk[c]; }
+                        }
+                    }
+                }
+
+                // y = t A
+                for (int i = 0; i < m; i++)
+                {
+                    const int x = (int)tx * m + i;
+                    if (x >= shape.x()) { break; }
+
+                    for (int j = 0; j < m; j++)
+                    {
+                        const int yo = (int)ty * m + j;
+                        if (yo >= shape.y()) { break; }
+
+                        std::fill(y, y + depth, T(0));
+                        for (int k = 0; k < alpha; k++)
+                        {
+                            const T a = at[j * alpha + k];
+                            if (a == T(0)) { continue; }
+                            T const *tk = &t[(i * alpha + k) * depth];
+                            for (size_t c = 0; c < depth; c++) { y[c] += a * tk[c]; }
+                        }
+
+                        T *o = output.ptr(x, yo);
+                        for (size_t c = 0; c < depth; c++) { o[c] = epilogue(c, y[c]); }
+                    }
+                }
+            }
+        }
+
+        bias_epilogue_t bias_epilogue() const { return bias_epilogue_t{this->filter_biases_.raw(), &this->activation_}; }
+
+    private:
+        bool filters_valid_ = false;
+        std::vector<T> forward_filters_, backward_filters_;
+        // transformed tiles of the last convolution
+        std::vector<T> transformed_input_, transformed_output_;
+        // per-thread tiles of the transforms
+        thread_scratch_t<T> scratch_;
+        array3d_t<T> padded_delta_, padded_gradient_;
+        array4d_t<T> batch_padded_delta_, batch_padded_gradient_;
+    };
+}
+
+#endif // CONVOLUTIONLAYER_WINOGRAD_H
@@ -29,11 +29,22 @@ namespace yannpp {
             return last_activation_;
         }
 
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override {
+            last_batch_activation_ = std::move(input);
+            return last_batch_activation_;
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&result) override {
+            last_batch_activation_.subtract(result);
+            return last_batch_activation_;
+        }
+
         virtual void optimize(optimizer_t<T> const &) override {}
         virtual void load(std::vector<array3d_t<T>> &&, std::vector<array3d_t<T>> &&) override {}
 
     private:
         array3d_t<T> last_activation_;
+        array4d_t<T> last_batch_activation_;
     };
 }
 
@@ -5,24 +5,31 @@
 
 #include <yannpp/optimizer/optimizer.h>
 #include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
 #include <yannpp/common/array3d_math.h>
 #include <yannpp/common/log.h>
 #include <yannpp/common/shape.h>
 #include <yannpp/network/activator.h>
+#include <yannpp/layers/layer_activation.h>
 #include <yannpp/layers/layer_base.h>
 #include <yannpp/layers/layer_metadata.h>
 
 namespace yannpp {
-    template<typename T = double>
+    // Activation is either activator_t<T> or one of compile-time policies
+    // (e.g. fully_connected_layer_t<float, relu_activation_t>)
+    template<typename T = double, typename Activation = activator_t<T>>
     class fully_connected_layer_t: public layer_base_t<T> {
+        using activation_type = layer_activation_t<T, Activation>;
+
     public:
         fully_connected_layer_t(size_t layer_in,
                                 size_t layer_out,
-                                activator_t<T> const &activator,
+                                typename activation_type::argument_type const &activation = typename activation_type::argument_type(),
                                 layer_metadata_t const &metadata = {}):
             layer_base_t<T>(metadata),
-            activator_(activator),
-            input_shape_(layer_out, layer_in, 1)
+            activation_(activation),
+            input_shape_(layer_out, layer_in, 1),
+            batch_input_shape_(0, 0, 0)
         { }
 
     public:
@@ -50,26 +57,81 @@ namespace yannpp {
             input_ = std::move(input);
             input_.flatten();
             // z = w*a + b
-            output_ = dot21(weights_, input_); output_.add(bias_);
-            return activator_.activate(output_);
+            output_ = dot21(weights_, input_, this->get_execution_context());
+            T *z = output_.raw();
+            T const *bias = bias_.raw();
+            const size_t size = output_.size();
+            for (size_t i = 0; i < size; i++) { z[i] = activation_.value(z[i] + bias[i]); }
+            return activation_.activate(output_);
         }
 
         virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override {
-            array3d_t<T> delta, delta_next, delta_nabla_w;
+            array3d_t<T> delta_next;
             // delta(l) = (w(l+1) * delta(l+1)) [X] derivative(z(l))
             // (w(l+1) * delta(l+1)) comes as the gradient (error) from the "previous" layer
-            delta = activator_.derivative(output_); delta.element_mul(error);
+            array3d_t<T> delta = activation_.delta(output_, std::move(error));
             // dC/db = delta(l)
             nabla_b_.add(delta);
-            // dC/dw = a(l-1) * delta(l)
-            delta_nabla_w = outer_product(delta, input_);
-            nabla_w_.add(delta_nabla_w);
+            // dC/dw = a(l-1) * delta(l) accumulated in place (rank-1 update)
+            add_outer_product(nabla_w_, delta, input_, this->get_execution_context());
             // w(l) * delta(l)
-            delta_next = transpose_dot21(weights_, delta);
+            delta_next = transpose_dot21(weights_, delta, this->get_execution_context());
             delta_next.reshape(input_shape_);
             return delta_next;
         }
 
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override {
+            const int layer_in = weights_.shape().y(), layer_out = weights_.shape().x();
+            const size_t batch_size = input.batch_size();
+            batch_input_shape_ = input.shape();
+            batch_input_ = std::move(input);
+            batch_input_.reshape(shape_row(layer_in));
+            // Z = A * w^T + b where each row of A and Z is one sample
+            array4d_t<T> output(batch_size, shape_row(layer_out), T(0));
+            gemm(transpose_type::no, transpose_type::yes,
+                 batch_size, layer_out, layer_in,
+                 T(1), batch_input_.raw(), layer_in,
+                 weights_.raw(), layer_in,
+                 T(0), output.raw(), layer_out,
+                 this->threads_for(parallel_op::gemm, batch_size * layer_out * layer_in));
+            T const *bias = bias_.raw();
+            for (size_t n = 0; n < batch_size; n++) {
+                T *z = output.sample(n);
+                for (int i = 0; i < layer_out; i++) { z[i] = activation_.value(z[i] + bias[i]); }
+            }
+            batch_output_ = std::move(output);
+            return activation_.activate(batch_output_);
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override {
+            const int layer_in = weights_.shape().y(), layer_out = weights_.shape().x();
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> delta = activation_.delta(batch_output_, std::move(error));
+            // dC/db = sum of delta(l) over the minibatch
+            T *nabla_b = nabla_b_.raw();
+            for (size_t n = 0; n < batch_size; n++) {
+                T const *d = delta.sample(n);
+                for (int i = 0; i < layer_out; i++) { nabla_b[i] += d[i]; }
+            }
+            // dC/dw = delta(l)^T * A(l-1) sums outer products of all samples (rank-k update)
+            gemm(transpose_type::yes, transpose_type::no,
+                 layer_out, layer_in, batch_size,
+                 T(1), delta.raw(), layer_out,
+                 batch_input_.raw(), layer_in,
+                 T(1), nabla_w_.raw(), layer_in,
+                 this->threads_for(parallel_op::gemm, batch_size * layer_out * layer_in));
+            // delta(l) * w(l)
+            array4d_t<T> delta_next(batch_size, shape_row(layer_in), T(0));
+            gemm(transpose_type::no, transpose_type::no,
+                 batch_size, layer_in, layer_out,
+                 T(1), delta.raw(), layer_out,
+                 weights_.raw(), layer_in,
+                 T(0), delta_next.raw(), layer_in,
+                 this->threads_for(parallel_op::gemm, batch_size * layer_out * layer_in));
+            delta_next.reshape(batch_input_shape_);
+            return delta_next;
+        }
+
         virtual void optimize(optimizer_t<T> const &strategy) override {
             strategy.update_bias(bias_, nabla_b_);
             strategy.update_weights(weights_, nabla_w_);
@@ -95,12 +157,15 @@ namespace yannpp {
         // own data
         array3d_t<T> weights_;
         array3d_t<T> bias_;
-        activator_t<T> const &activator_;
+        activation_type activation_;
         // calculation support
         shape3d_t input_shape_;
+        // output_ is z for activator_t and a = f(z) for compile-time policies
         array3d_t<T> output_, input_;
         array3d_t<T> nabla_w_;
         array3d_t<T> nabla_b_;
+        shape3d_t batch_input_shape_;
+        array4d_t<T> batch_output_, batch_input_;
     };
 }
 
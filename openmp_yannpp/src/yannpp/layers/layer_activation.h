@@ -0,0 +1,90 @@
+#ifndef LAYER_ACTIVATION_H
+#define LAYER_ACTIVATION_H
+
+#include <cassert>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/network/activation_policies.h>
+#include <yannpp/network/activator.h>
+
+namespace yannpp {
+    // activation part of the layer with Activation template parameter
+    // layers apply value() to each z in the loop computing it, then activate()
+    // returns the activation and delta() computes gradient in place of error
+
+    // compile-time policy: output becomes activation a in place
+    // and derivative is computed from it without extra arrays
+    template<typename T, typename Activation>
+    class layer_activation_t {
+    public:
+        using argument_type = Activation;
+
+        layer_activation_t(Activation const &) { }
+
+    public:
+        inline T value(T z) const { return activate_value<Activation>(z); }
+
+        array3d_t<T> activate(array3d_t<T> &output) {
+            if (!is_elementwise<Activation>::value) { activate_sample<Activation>(output.raw(), output.size()); }
+            return output.clone();
+        }
+
+        array4d_t<T> activate(array4d_t<T> &output) {
+            if (!is_elementwise<Activation>::value) {
+                const size_t size = output.shape().capacity();
+                for (size_t n = 0; n < output.batch_size(); n++) {
+                    activate_sample<Activation>(output.sample(n), size);
+                }
+            }
+            return output.clone();
+        }
+
+        array3d_t<T> delta(array3d_t<T> const &output, array3d_t<T> &&error) {
+            assert(output.size() == error.size());
+            delta_sample<Activation>(output.raw(), error.raw(), error.size());
+            error.reshape(output.shape());
+            return std::move(error);
+        }
+
+        array4d_t<T> delta(array4d_t<T> const &output, array4d_t<T> &&error) {
+            assert(output.size() == error.size());
+            delta_sample<Activation>(output.raw(), error.raw(), error.size());
+            error.reshape(output.shape());
+            return std::move(error);
+        }
+    };
+
+    // runtime activator_t: output keeps z, activation is a new array
+    template<typename T>
+    class layer_activation_t<T, activator_t<T>> {
+    public:
+        using argument_type = activator_t<T>;
+
+        layer_activation_t(activator_t<T> const &activator):
+            activator_(activator)
+        { }
+
+    public:
+        inline T value(T z) const { return z; }
+
+        array3d_t<T> activate(array3d_t<T> &output) { return activator_.activate(output, activation_); }
+        array4d_t<T> activate(array4d_t<T> &output) { return activator_.activate(output, batch_activation_); }
+
+        array3d_t<T> delta(array3d_t<T> const &output, array3d_t<T> &&error) {
+            return activator_.delta(output, activation_, std::move(error));
+        }
+
+        array4d_t<T> delta(array4d_t<T> const &output, array4d_t<T> &&error) {
+            return activator_.delta(output, batch_activation_, std::move(error));
+        }
+
+    private:
+        activator_t<T> const &activator_;
+        // activation of the output kept only if activator derivative needs it
+        array3d_t<T> activation_;
+        array4d_t<T> batch_activation_;
+    };
+}
+
+#endif // LAYER_ACTIVATION_H
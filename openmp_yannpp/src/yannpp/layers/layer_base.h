@@ -4,6 +4,9 @@
 #include <vector>
 
 #include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/execution_context.h>
+#include <yannpp/common/parallel_for.h>
 #include <yannpp/layers/layer_metadata.h>
 
 namespace yannpp {
@@ -13,21 +16,44 @@ namespace yannpp {
     template<typename T>
     class layer_base_t {
     public:
-        layer_base_t(layer_metadata_t const &m={}): metadata_(m) {}
+        layer_base_t(layer_metadata_t const &m={}): metadata_(m), context_(&get_default_execution_context()) {}
         virtual ~layer_base_t() {}
         // input is the output of the previous layer
         virtual array3d_t<T> feedforward(array3d_t<T> &&input) = 0;
         // error is the gradient with regards to input
         virtual array3d_t<T> backpropagate(array3d_t<T> &&error) = 0;
+        // same as above for the whole minibatch of inputs at once
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) = 0;
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) = 0;
         virtual void load(std::vector<array3d_t<T>> &&weights, std::vector<array3d_t<T>> &&biases) = 0;
         virtual void optimize(optimizer_t<T> const &) = 0;
         virtual void init() = 0;
 
     public:
         layer_metadata_t const &get_metadata() const { return metadata_; }
+        // context has to outlive the layer (network2_t sets its own)
+        void set_execution_context(execution_context_t const &context) { context_ = &context; }
+        execution_context_t const &get_execution_context() const { return *context_; }
+
+    protected:
+        inline int threads_for(parallel_op op, size_t work) const { return context_->threads_for(op, work); }
+
+        // parallel_for() and parallel_for_2d() with the context of the layer
+        template<typename F>
+        void parallel_for(parallel_op op, size_t work, size_t begin, size_t end, F const &f,
+                          size_t grain = 1, schedule_type schedule = schedule_type::blocked) const {
+            yannpp::parallel_for(*context_, op, work, begin, end, f, grain, schedule);
+        }
+
+        template<typename F>
+        void parallel_for_2d(parallel_op op, size_t work, size_t n0, size_t n1, F const &f,
+                             size_t grain = 1, schedule_type schedule = schedule_type::blocked) const {
+            yannpp::parallel_for_2d(*context_, op, work, n0, n1, f, grain, schedule);
+        }
 
     private:
         layer_metadata_t metadata_;
+        execution_context_t const *context_;
     };
 }
 
@@ -1,6 +1,10 @@
 #ifndef POOLINGLAYER_H
 #define POOLINGLAYER_H
 
+#include <algorithm>
+#include <cassert>
+
+#include <yannpp/common/array4d.h>
 #include <yannpp/common/shape.h>
 #include <yannpp/layers/layer_base.h>
 #include <yannpp/layers/layer_metadata.h>
@@ -10,6 +14,10 @@
 namespace yannpp {
 #define POOL_DIM(input, pool, stride) (((input) - (pool))/(stride) + 1)
 
+    // max pooling, channels are innermost so every kernel processes all channels
+    // of a window position as one vector operation
+    // argmax is kept as window-local index (wx * window_size + wy) in one byte per output
+    // and backpropagation adds errors to these positions of the input rows
     template <typename T>
     class pooling_layer_t: public layer_base_t<T> {
     public:
@@ -20,86 +28,70 @@ namespace yannpp {
             window_size_(window_size),
             input_shape_(0, 0, 0),
             stride_(stride_length, stride_length, 0)
-        { }
+        {
+            // window-local index has to fit into unsigned char
+            assert(window_size * window_size <= 256);
+        }
 
     public:
         virtual void init() override { }
 
         virtual array3d_t<T> feedforward(array3d_t<T> &&input) override {
             input_shape_ = input.shape();
-            // downsample input using window with step stride
-            shape3d_t output_shape(POOL_DIM(input_shape_.x(), window_size_, stride_.x()),
-                                   POOL_DIM(input_shape_.y(), window_size_, stride_.y()),
-                                   input_shape_.z());
+            const shape3d_t output_shape = get_output_shape();
             array3d_t<T> result(output_shape, T(0));
-            max_index_ = array3d_t<index3d_t>(output_shape, index3d_t(0, 0, 0));
-
-            // z axis corresponds to each filter from convolution layer
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = output_shape.z() / thread_count;
-            size_t sub = output_shape.z() % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (int z = start; z < end; z++) {
-                // 2D loop over convoluted image from each filter
-                for (int y = 0; y < output_shape.y(); y++) {
-                    int ys = y * stride_.y();
-
-                    for (int x = 0; x < output_shape.x(); x++) {
-                        int xs = x * stride_.x();
-                        // pooling layer does max-pooling, selecting a maximum
-                        // activation within the bounds of it's "window"
-                        auto input_slice = input.slice(
-                                               index3d_t(xs, ys, z),
-                                               index3d_t(xs + window_size_ - 1,
-                                                         ys + window_size_ - 1,
-                                                         z));
-                        max_index_(x, y, z) = input_slice.argmax();
-                        result(x, y, z) = input_slice.at(max_index_(x, y, z));
-                    }
-                }
-            }
-}
+            if (max_index_.shape() != output_shape) { max_index_ = array3d_t<unsigned char>(output_shape, (unsigned char)0); }
+
+            view3d_t<T const> in = input.view();
+            view3d_t<T> out = result.view();
+            view3d_t<unsigned char> index = max_index_.view();
+            this->parallel_for(parallel_op::pooling, input_shape_.capacity(), 0, output_shape.x(), [&](size_t x) {
+                pool_row(in, x, out, index);
+            });
 
             return result;
         }
 
         virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override {
-            auto &error_shape = error.shape();
-            array3d_t<T> output(input_shape_, T(0));
             assert(error.shape() == max_index_.shape());
+            array3d_t<T> output(input_shape_, T(0));
 
-            // z axis corresponds to each filter from convolution layer
-#   pragma omp parallel num_threads(num_threads)
-{
-            size_t my_rank = omp_get_thread_num();
-            size_t thread_count = omp_get_num_threads();
-            size_t local_x = error_shape.z() / thread_count;
-            size_t sub = error_shape.z() % thread_count;
-            size_t start = my_rank * local_x + (sub > my_rank ? my_rank : sub);
-            size_t end = start + local_x + (sub > my_rank ? 1 : 0);
-            for (int z = start; z < end; z++) {
-                // 2D loop same as in feedforward()
-                for (int y = 0; y < error_shape.y(); y++) {
-                    int ys = y * stride_.y();
-
-                    for (int x = 0; x < error_shape.x(); x++) {
-                        int xs = x * stride_.x();
-
-                        // same slice as input used for max() calculation
-                        output.slice(
-                                    index3d_t(xs, ys, z),
-                                    index3d_t(xs + window_size_ - 1,
-                                              ys + window_size_ - 1,
-                                              z))
-                                .at(max_index_(x, y, z)) = error(x, y, z);
-                    }
-                }
+            view3d_t<T const> e = error.view();
+            view3d_t<unsigned char const> index = max_index_.view();
+            view3d_t<T> out = output.view();
+            this->parallel_for(parallel_op::pooling, input_shape_.capacity(), 0, unpool_rows(), [&](size_t x) {
+                unpool_row(e, index, x, out);
+            });
+
+            return output;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override {
+            input_shape_ = input.shape();
+            const shape3d_t output_shape = get_output_shape();
+            const size_t batch_size = input.batch_size();
+            array4d_t<T> result(batch_size, output_shape, T(0));
+            if (batch_max_index_.batch_size() != batch_size || batch_max_index_.shape() != output_shape) {
+                batch_max_index_ = array4d_t<unsigned char>(batch_size, output_shape, (unsigned char)0);
             }
-}
+
+            // each (sample, row) pair is pooled independently
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_shape_.capacity(), batch_size, output_shape.x(), [&](size_t n, size_t x) {
+                pool_row(input.view(n), x, result.view(n), batch_max_index_.view(n));
+            });
+
+            return result;
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override {
+            assert(error.shape() == batch_max_index_.shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> output(batch_size, input_shape_, T(0));
+
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_shape_.capacity(), batch_size, unpool_rows(), [&](size_t n, size_t x) {
+                view3d_t<unsigned char const> index = batch_max_index_.view(n);
+                unpool_row(error.view(n), index, x, output.view(n));
+            });
 
             return output;
         }
@@ -109,11 +101,118 @@ namespace yannpp {
         }
         virtual void load(std::vector<array3d_t<T>> &&, std::vector<array3d_t<T>> &&) override {}
 
+    public:
+        // valid after the first feedforward
+        shape3d_t get_output_shape() const {
+            return shape3d_t(POOL_DIM(input_shape_.x(), (int)window_size_, stride_.x()),
+                             POOL_DIM(input_shape_.y(), (int)window_size_, stride_.y()),
+                             input_shape_.z());
+        }
+
+    private:
+        // common 2x2 and 3x3 windows get kernels with unrolled window loops
+        void pool_row(view3d_t<T const> const &in, size_t x, view3d_t<T> const &out, view3d_t<unsigned char> const &index) const {
+            switch (window_size_) {
+            case 2: pool_row_kernel<2>(in, x, out, index); break;
+            case 3: pool_row_kernel<3>(in, x, out, index); break;
+            default: pool_row_kernel<0>(in, x, out, index); break;
+            }
+        }
+
+        // output row x, window positions are visited in (wx, wy) order and only
+        // a greater value replaces the maximum so the first maximum wins
+        // (Window is 0 when window size is known only at runtime)
+        template<int Window>
+        void pool_row_kernel(view3d_t<T const> const &in, size_t x, view3d_t<T> const &out, view3d_t<unsigned char> const &index) const {
+            const int window = (Window > 0) ? Window : (int)window_size_;
+            const int depth = input_shape_.z();
+            const int xs = (int)x * stride_.x();
+
+            for (int y = 0; y < out.shape().y(); y++) {
+                const int ys = y * stride_.y();
+                T *o = out.ptr(x, y);
+                unsigned char *m = index.ptr(x, y);
+                T const *first = in.ptr(xs, ys);
+                for (int z = 0; z < depth; z++) { o[z] = first[z]; m[z] = 0; }
+
+                for (int wx = 0; wx < window; wx++) {
+                    for (int wy = (wx == 0) ? 1 : 0; wy < window; wy++) {
+                        T const *a = in.ptr(xs + wx, ys + wy);
+                        const unsigned char i = (unsigned char)(wx * window + wy);
+#   pragma omp simd
+                        for (int z = 0; z < depth; z++) {
+                            const bool greater = a[z] > o[z];
+                            o[z] = greater ? a[z] : o[z];
+                            m[z] = greater ? i : m[z];
+                        }
+                    }
+                }
+            }
+        }
+
+        // windows of different output rows don't overlap when stride isn't less than window
+        // so output rows are scattered independently, otherwise rows of the input gradient
+        // gather errors of all windows that cover them
+        inline bool windows_overlap() const { return stride_.x() < (int)window_size_; }
+        inline size_t unpool_rows() const { return windows_overlap() ? input_shape_.x() : get_output_shape().x(); }
+
+        void unpool_row(view3d_t<T const> const &error, view3d_t<unsigned char const> const &index, size_t x, view3d_t<T> const &out) const {
+            if (windows_overlap()) { gather_row(error, index, x, out); return; }
+            switch (window_size_) {
+            case 2: scatter_row<2>(error, index, x, out); break;
+            case 3: scatter_row<3>(error, index, x, out); break;
+            default: scatter_row<0>(error, index, x, out); break;
+            }
+        }
+
+        // adds errors of output row ex to argmax positions of their windows
+        template<int Window>
+        void scatter_row(view3d_t<T const> const &error, view3d_t<unsigned char const> const &index, size_t ex, view3d_t<T> const &out) const {
+            const int window = (Window > 0) ? Window : (int)window_size_;
+            const int depth = input_shape_.z();
+            const int xs = (int)ex * stride_.x();
+
+            const size_t x_stride = out.x_stride();
+            for (int ey = 0; ey < error.shape().y(); ey++) {
+                T const *e = error.ptr(ex, ey);
+                unsigned char const *m = index.ptr(ex, ey);
+                T *o = out.ptr(xs, ey * stride_.y());
+                for (int z = 0; z < depth; z++) {
+                    o[(m[z] / window) * x_stride + (m[z] % window) * depth + z] += e[z];
+                }
+            }
+        }
+
+        // adds errors of all windows that cover input row x to their argmax positions in this row
+        void gather_row(view3d_t<T const> const &error, view3d_t<unsigned char const> const &index, size_t x, view3d_t<T> const &out) const {
+            const int window = (int)window_size_;
+            const int depth = input_shape_.z();
+            const int sx = stride_.x(), sy = stride_.y();
+            // output rows ex with ex * sx <= x < ex * sx + window
+            const int ex0 = ((int)x < window) ? 0 : ((int)x - window) / sx + 1;
+            const int ex1 = std::min(error.shape().x(), (int)x / sx + 1);
+
+            for (int ex = ex0; ex < ex1; ex++) {
+                // indices of the window row that lies in input row x
+                const int first = ((int)x - ex * sx) * window;
+                for (int ey = 0; ey < error.shape().y(); ey++) {
+                    T const *e = error.ptr(ex, ey);
+                    unsigned char const *m = index.ptr(ex, ey);
+                    T *o = out.ptr(x, ey * sy);
+                    for (int z = 0; z < depth; z++) {
+                        const int wy = (int)m[z] - first;
+                        if (wy >= 0 && wy < window) { o[wy * depth + z] += e[z]; }
+                    }
+                }
+            }
+        }
+
     private:
         size_t window_size_;
         shape3d_t input_shape_;
         point3d_t<int> stride_;
-        array3d_t<index3d_t> max_index_;
+        array3d_t<unsigned char> max_index_;
+        array4d_t<unsigned char> batch_max_index_;
     };
 }
 
@@ -0,0 +1,282 @@
+#ifndef POOLINGLAYER_AVERAGE_H
+#define POOLINGLAYER_AVERAGE_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <yannpp/common/array4d.h>
+#include <yannpp/common/shape.h>
+#include <yannpp/layers/layer_base.h>
+#include <yannpp/layers/layer_metadata.h>
+#include <yannpp/layers/poolinglayer.h>
+
+namespace yannpp {
+    namespace detail {
+        // dst[i] = scale * sum of src[j] for j in [begin, end) given by bounds(i, begin, end)
+        // where src and dst elements are vectors of run values
+        // both bounds never decrease with i so the sum is updated by adding vectors that
+        // enter the range and subtracting vectors that leave it (restarted when range is empty)
+        // and the cost doesn't depend on the size of the range
+        template <typename T, typename Bounds>
+        void running_sums(T const *src, size_t src_stride, T *dst, size_t dst_stride,
+                          int count, int run, T scale, Bounds const &bounds) {
+            std::vector<T> sum(run, T(0));
+            int lo = 0, hi = 0;
+            for (int i = 0; i < count; i++) {
+                int begin = 0, end = 0;
+                bounds(i, begin, end);
+                if (begin >= hi) {
+                    std::fill(sum.begin(), sum.end(), T(0));
+                    lo = hi = begin;
+                }
+                for (; hi < end; hi++) {
+                    T const *s = src + hi * src_stride;
+#   pragma omp simd
+                    for (int k = 0; k < run; k++) { sum[k] += s[k]; }
+                }
+                for (; lo < begin; lo++) {
+                    T const *s = src + lo * src_stride;
+#   pragma omp simd
+                    for (int k = 0; k < run; k++) { sum[k] -= s[k]; }
+                }
+
+                T *d = dst + i * dst_stride;
+#   pragma omp simd
+                for (int k = 0; k < run; k++) { d[k] = scale * sum[k]; }
+            }
+        }
+    }
+
+    // average pooling as two separable passes of running window sums:
+    // along x into [output x, input y] partial sums and then along y
+    // backward is the same with the ranges of outputs that cover each input
+    template <typename T>
+    class average_pooling_layer_t: public layer_base_t<T> {
+    public:
+        average_pooling_layer_t(size_t window_size,
+                                int stride_length,
+                                layer_metadata_t const &metadata = {}):
+            layer_base_t<T>(metadata),
+            window_size_(window_size),
+            input_shape_(0, 0, 0),
+            stride_(stride_length, stride_length, 0)
+        { }
+
+    public:
+        virtual void init() override { }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override {
+            input_shape_ = input.shape();
+            array3d_t<T> result(get_output_shape(), T(0));
+            prepare_sums(1);
+            pool(input.raw(), sums_.raw(), result.raw(), 1);
+            return result;
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override {
+            assert(error.shape() == get_output_shape());
+            array3d_t<T> output(input_shape_, T(0));
+            prepare_sums(1);
+            unpool(error.raw(), sums_.raw(), output.raw(), 1);
+            return output;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override {
+            input_shape_ = input.shape();
+            const size_t batch_size = input.batch_size();
+            array4d_t<T> result(batch_size, get_output_shape(), T(0));
+            prepare_sums(batch_size);
+            pool(input.raw(), sums_.raw(), result.raw(), batch_size);
+            return result;
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override {
+            assert(error.shape() == get_output_shape());
+            const size_t batch_size = error.batch_size();
+            array4d_t<T> output(batch_size, input_shape_, T(0));
+            prepare_sums(batch_size);
+            unpool(error.raw(), sums_.raw(), output.raw(), batch_size);
+            return output;
+        }
+
+        virtual void optimize(optimizer_t<T> const &) override {
+            // no weight update is done in pooling layer
+        }
+        virtual void load(std::vector<array3d_t<T>> &&, std::vector<array3d_t<T>> &&) override {}
+
+    public:
+        // valid after the first feedforward
+        shape3d_t get_output_shape() const {
+            return shape3d_t(POOL_DIM(input_shape_.x(), (int)window_size_, stride_.x()),
+                             POOL_DIM(input_shape_.y(), (int)window_size_, stride_.y()),
+                             input_shape_.z());
+        }
+
+    private:
+        // partial sums are [output x, input y, depth] for forward and
+        // [output x, input y, depth] of summed errors for backward as well
+        void prepare_sums(size_t batch_size) {
+            const shape3d_t sums_shape(get_output_shape().x(), input_shape_.y(), input_shape_.z());
+            if (sums_.batch_size() != batch_size || sums_.shape() != sums_shape) {
+                sums_ = array4d_t<T>(batch_size, sums_shape, T(0));
+            }
+        }
+
+        // [begin, end) of inputs of the window of output o
+        inline void window_bounds(int o, int stride, int &begin, int &end) const {
+            begin = o * stride;
+            end = begin + (int)window_size_;
+        }
+
+        // [begin, end) of outputs whose windows cover input i
+        inline void covering_bounds(int i, int stride, int outputs, int &begin, int &end) const {
+            begin = (i < (int)window_size_) ? 0 : (i - (int)window_size_) / stride + 1;
+            end = std::min(outputs, i / stride + 1);
+        }
+
+        void pool(T const *input, T *sums, T *output, size_t batch_size) {
+            const shape3d_t output_shape = get_output_shape();
+            const int depth = input_shape_.z();
+            const size_t input_size = input_shape_.capacity(), sums_size = sums_.shape().capacity();
+            const size_t plane = (size_t)input_shape_.y() * depth;
+            const T scale = T(1) / T(window_size_ * window_size_);
+
+            // window sums along x for every (y, z) column of the input
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_size, batch_size, input_shape_.y(), [&](size_t n, size_t y) {
+                detail::running_sums(input + n * input_size + y * depth, plane,
+                                     sums + n * sums_size + y * depth, plane,
+                                     output_shape.x(), depth, T(1),
+                                     [&](int o, int &begin, int &end) { window_bounds(o, stride_.x(), begin, end); });
+            });
+
+            // window sums of partial sums along y for every output row
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_size, batch_size, output_shape.x(), [&](size_t n, size_t x) {
+                detail::running_sums(sums + n * sums_size + x * plane, depth,
+                                     output + n * output_shape.capacity() + x * output_shape.y() * depth, depth,
+                                     output_shape.y(), depth, scale,
+                                     [&](int o, int &begin, int &end) { window_bounds(o, stride_.y(), begin, end); });
+            });
+        }
+
+        void unpool(T const *error, T *sums, T *output, size_t batch_size) {
+            const shape3d_t output_shape = get_output_shape();
+            const int depth = input_shape_.z();
+            const size_t input_size = input_shape_.capacity(), sums_size = sums_.shape().capacity();
+            const size_t plane = (size_t)input_shape_.y() * depth;
+            const T scale = T(1) / T(window_size_ * window_size_);
+
+            // errors of every output row summed over outputs that cover each input y
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_size, batch_size, output_shape.x(), [&](size_t n, size_t x) {
+                detail::running_sums(error + n * output_shape.capacity() + x * output_shape.y() * depth, depth,
+                                     sums + n * sums_size + x * plane, depth,
+                                     input_shape_.y(), depth, T(1),
+                                     [&](int i, int &begin, int &end) { covering_bounds(i, stride_.y(), output_shape.y(), begin, end); });
+            });
+
+            // and then over output rows that cover each input x
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_size, batch_size, input_shape_.y(), [&](size_t n, size_t y) {
+                detail::running_sums(sums + n * sums_size + y * depth, plane,
+                                     output + n * input_size + y * depth, plane,
+                                     input_shape_.x(), depth, scale,
+                                     [&](int i, int &begin, int &end) { covering_bounds(i, stride_.x(), output_shape.x(), begin, end); });
+            });
+        }
+
+    private:
+        size_t window_size_;
+        shape3d_t input_shape_;
+        point3d_t<int> stride_;
+        array4d_t<T> sums_;
+    };
+
+    // average of every channel over the whole input, output is (1, 1, depth)
+    template <typename T>
+    class global_average_pooling_layer_t: public layer_base_t<T> {
+    public:
+        global_average_pooling_layer_t(layer_metadata_t const &metadata = {}):
+            layer_base_t<T>(metadata),
+            input_shape_(0, 0, 0)
+        { }
+
+    public:
+        virtual void init() override { }
+
+        virtual array3d_t<T> feedforward(array3d_t<T> &&input) override {
+            input_shape_ = input.shape();
+            array3d_t<T> result(get_output_shape(), T(0));
+            average(input.raw(), result.raw());
+            return result;
+        }
+
+        virtual array3d_t<T> backpropagate(array3d_t<T> &&error) override {
+            assert(error.shape() == get_output_shape());
+            array3d_t<T> output(input_shape_, T(0));
+            this->parallel_for(parallel_op::pooling, input_shape_.capacity(), 0, input_shape_.x(), [&](size_t x) {
+                spread_row(error.raw(), x, output.raw());
+            });
+            return output;
+        }
+
+        virtual array4d_t<T> feedforward_batch(array4d_t<T> &&input) override {
+            input_shape_ = input.shape();
+            const size_t batch_size = input.batch_size();
+            const size_t depth = input_shape_.z();
+            array4d_t<T> result(batch_size, get_output_shape(), T(0));
+            this->parallel_for(parallel_op::pooling, batch_size * input_shape_.capacity(), 0, batch_size, [&](size_t n) {
+                average(input.sample(n), result.raw() + n * depth);
+            });
+            return result;
+        }
+
+        virtual array4d_t<T> backpropagate_batch(array4d_t<T> &&error) override {
+            assert(error.shape() == get_output_shape());
+            const size_t batch_size = error.batch_size();
+            const size_t depth = input_shape_.z();
+            array4d_t<T> output(batch_size, input_shape_, T(0));
+            this->parallel_for_2d(parallel_op::pooling, batch_size * input_shape_.capacity(), batch_size, input_shape_.x(), [&](size_t n, size_t x) {
+                spread_row(error.raw() + n * depth, x, output.sample(n));
+            });
+            return output;
+        }
+
+        virtual void optimize(optimizer_t<T> const &) override {
+            // no weight update is done in pooling layer
+        }
+        virtual void load(std::vector<array3d_t<T>> &&, std::vector<array3d_t<T>> &&) override {}
+
+    public:
+        // valid after the first feedforward
+        shape3d_t get_output_shape() const { return shape3d_t(1, 1, input_shape_.z()); }
+
+    private:
+        // channels are innermost so every position adds one contiguous vector
+        void average(T const *input, T *output) const {
+            const int depth = input_shape_.z();
+            const size_t positions = (size_t)input_shape_.x() * input_shape_.y();
+            for (size_t p = 0; p < positions; p++) {
+                T const *a = input + p * depth;
+#   pragma omp simd
+                for (int z = 0; z < depth; z++) { output[z] += a[z]; }
+            }
+            const T scale = T(1) / T(positions);
+            for (int z = 0; z < depth; z++) { output[z] *= scale; }
+        }
+
+        // every input of row x gets the same share of the error of its channel
+        void spread_row(T const *error, size_t x, T *output) const {
+            const int depth = input_shape_.z();
+            const T scale = T(1) / T((size_t)input_shape_.x() * input_shape_.y());
+            T *o = output + x * input_shape_.y() * depth;
+            for (int y = 0; y < input_shape_.y(); y++, o += depth) {
+#   pragma omp simd
+                for (int z = 0; z < depth; z++) { o[z] = scale * error[z]; }
+            }
+        }
+
+    private:
+        shape3d_t input_shape_;
+    };
+}
+
+#endif // POOLINGLAYER_AVERAGE_H
@@ -0,0 +1,84 @@
+#ifndef ACTIVATION_POLICIES_H
+#define ACTIVATION_POLICIES_H
+
+#include <cstddef>
+#include <type_traits>
+
+#include <yannpp/network/activations.h>
+
+namespace yannpp {
+    // compile-time activations used as layer template parameters instead of activator_t
+    // element-wise policies provide a = activate(z) for a single value so layers
+    // apply it right in the loop computing z, others activate a whole sample in place
+    // derivative is always computed from activation a and not from z
+
+    struct identity_activation_t {
+        enum { elementwise = 1 };
+        template<typename T> static inline T activate(T z) { return z; }
+        template<typename T> static inline T derivative(T) { return T(1); }
+    };
+
+    struct relu_activation_t {
+        enum { elementwise = 1 };
+        template<typename T> static inline T activate(T z) { return (z > T(0)) ? z : T(0); }
+        // a > 0 if and only if z > 0
+        template<typename T> static inline T derivative(T a) { return (a > T(0)) ? T(1) : T(0); }
+    };
+
+    struct sigmoid_activation_t {
+        enum { elementwise = 1 };
+        template<typename T> static inline T activate(T z) { return T(1) / (T(1) + fast_exp(-z)); }
+        template<typename T> static inline T derivative(T a) { return a * (T(1) - a); }
+    };
+
+    // to be used only before crossentropy_output_layer_t which cancels out the derivative
+    struct softmax_activation_t {
+        enum { elementwise = 0 };
+        template<typename T> static inline void activate(T *v, size_t size) { softmax_kernel(v, v, size); }
+        template<typename T> static inline T derivative(T) { return T(1); }
+    };
+
+    namespace detail {
+        template<typename Activation, typename T>
+        inline void activate_sample(T *v, size_t size, std::true_type) {
+#   pragma omp simd
+            for (size_t i = 0; i < size; i++) { v[i] = Activation::activate(v[i]); }
+        }
+
+        template<typename Activation, typename T>
+        inline void activate_sample(T *v, size_t size, std::false_type) {
+            Activation::activate(v, size);
+        }
+
+        template<typename Activation, typename T>
+        inline T activate_value(T z, std::true_type) { return Activation::activate(z); }
+
+        template<typename Activation, typename T>
+        inline T activate_value(T z, std::false_type) { return z; }
+    }
+
+    template<typename Activation>
+    struct is_elementwise: std::integral_constant<bool, Activation::elementwise != 0> {};
+
+    // z -> a for one sample in place
+    template<typename Activation, typename T>
+    inline void activate_sample(T *v, size_t size) {
+        detail::activate_sample<Activation>(v, size, is_elementwise<Activation>());
+    }
+
+    // a = f(z) for element-wise policies, z for the rest
+    // (they are applied to the whole sample with activate_sample() later)
+    template<typename Activation, typename T>
+    inline T activate_value(T z) {
+        return detail::activate_value<Activation>(z, is_elementwise<Activation>());
+    }
+
+    // error = f'(z) [X] error where a = f(z), in place of error
+    template<typename Activation, typename T>
+    inline void delta_sample(T const *a, T *error, size_t size) {
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) { error[i] *= Activation::derivative(a[i]); }
+    }
+}
+
+#endif // ACTIVATION_POLICIES_H
@@ -0,0 +1,172 @@
+#ifndef ACTIVATIONS_H
+#define ACTIVATIONS_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <yannpp/common/array3d.h>
+#include <yannpp/network/activator.h>
+
+namespace yannpp {
+    // exp(x) for float without calls and branches so loops with it are vectorized
+    // x = n * ln(2) + r, |r| <= ln(2) / 2 and exp(x) = 2^n * exp(r)
+    // where exp(r) is approximated by polynomial (cephes expf, ~1 ulp)
+    // x is clamped to [-87.3, 88] so result is always finite and normal
+    inline float fast_exp(float x) {
+        x = (x < -87.3f) ? -87.3f : ((x > 88.f) ? 88.f : x);
+
+        // rounding by adding 1.5 * 2^23 leaves n in the low bits of mantissa
+        // (float to int conversion would prevent vectorization because of the clamp above)
+        const float shifter = 12582912.f;
+        const float t = x * 1.44269504088896341f + shifter;
+        const float nf = t - shifter;
+        int32_t t_bits;
+        std::memcpy(&t_bits, &t, sizeof(t_bits));
+        const int32_t n = t_bits - 0x4B400000;
+
+        // ln(2) is split in two parts to keep r precise
+        const float r = (x - nf * 0.693359375f) + nf * 2.12194440e-4f;
+        const float r2 = r * r;
+        float p = 1.9875691500e-4f;
+        p = p * r + 1.3981999507e-3f;
+        p = p * r + 8.3334519073e-3f;
+        p = p * r + 4.1665795894e-2f;
+        p = p * r + 1.6666665459e-1f;
+        p = p * r + 5.0000001201e-1f;
+        p = p * r2 + r + 1.f;
+
+        const int32_t scale_bits = (n + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &scale_bits, sizeof(scale));
+        return p * scale;
+    }
+
+    inline double fast_exp(double x) { return std::exp(x); }
+
+    // kernels over contiguous arrays, y may be the same as x
+
+    template<typename T>
+    void sigmoid_kernel(T const *x, T *y, size_t size) {
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) {
+            y[i] = T(1) / (T(1) + fast_exp(-x[i]));
+        }
+    }
+
+    // sigmoid'(z) from z, exponent is computed once
+    template<typename T>
+    void sigmoid_derivative_kernel(T const *x, T *y, size_t size) {
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) {
+            const T s = T(1) / (T(1) + fast_exp(-x[i]));
+            y[i] = s * (T(1) - s);
+        }
+    }
+
+    // sigmoid'(z) from a = sigmoid(z)
+    template<typename T>
+    void sigmoid_activation_derivative_kernel(T const *a, T *y, size_t size) {
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) {
+            y[i] = a[i] * (T(1) - a[i]);
+        }
+    }
+
+    template<typename T>
+    void relu_kernel(T const *x, T *y, size_t size) {
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) {
+            y[i] = (x[i] > T(0)) ? x[i] : T(0);
+        }
+    }
+
+    // same result for z and a = relu(z)
+    template<typename T>
+    void relu_derivative_kernel(T const *x, T *y, size_t size) {
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) {
+            y[i] = (x[i] > T(0)) ? T(1) : T(0);
+        }
+    }
+
+    template<typename T>
+    void softmax_kernel(T const *x, T *y, size_t size) {
+        assert(size > 0);
+        T x_max = x[0];
+#   pragma omp simd reduction(max:x_max)
+        for (size_t i = 0; i < size; i++) {
+            x_max = (x[i] > x_max) ? x[i] : x_max;
+        }
+
+        T sum = T(0);
+#   pragma omp simd reduction(+:sum)
+        for (size_t i = 0; i < size; i++) {
+            const T e = fast_exp(x[i] - x_max);
+            y[i] = e;
+            sum += e;
+        }
+
+        const T inv_sum = T(1) / sum;
+#   pragma omp simd
+        for (size_t i = 0; i < size; i++) {
+            y[i] *= inv_sum;
+        }
+    }
+
+    namespace detail {
+        template<typename T>
+        inline array3d_t<T> apply_kernel(void (*kernel)(T const *, T *, size_t), array3d_t<T> const &x) {
+            array3d_t<T> result(x.shape(), T(0));
+            kernel(x.raw(), result.raw(), x.size());
+            return result;
+        }
+    }
+
+    // drop-in replacements for *_v functions from array3d_math.h
+
+    template<typename T>
+    array3d_t<T> fast_sigmoid_v(array3d_t<T> const &x) { return detail::apply_kernel(sigmoid_kernel<T>, x); }
+
+    template<typename T>
+    array3d_t<T> fast_sigmoid_derivative_v(array3d_t<T> const &x) { return detail::apply_kernel(sigmoid_derivative_kernel<T>, x); }
+
+    template<typename T>
+    array3d_t<T> sigmoid_activation_derivative_v(array3d_t<T> const &a) { return detail::apply_kernel(sigmoid_activation_derivative_kernel<T>, a); }
+
+    template<typename T>
+    array3d_t<T> fast_relu_v(array3d_t<T> const &x) { return detail::apply_kernel(relu_kernel<T>, x); }
+
+    template<typename T>
+    array3d_t<T> relu_derivative_v(array3d_t<T> const &x) { return detail::apply_kernel(relu_derivative_kernel<T>, x); }
+
+    template<typename T>
+    array3d_t<T> fast_softmax_v(array3d_t<T> const &x) { return detail::apply_kernel(softmax_kernel<T>, x); }
+
+    // derivative of softmax followed by cross-entropy output layer
+    // (it is cancelled out in the cost derivative)
+    template<typename T>
+    array3d_t<T> ones_v(array3d_t<T> const &x) { return array3d_t<T>(x.shape(), T(1)); }
+
+    // activators built on the kernels above
+
+    // sigmoid derivative is taken from activation cached in the layer
+    template<typename T>
+    activator_t<T> make_sigmoid_activator() {
+        return activator_t<T>(fast_sigmoid_v<T>, sigmoid_activation_derivative_v<T>, derivative_arg::activation);
+    }
+
+    template<typename T>
+    activator_t<T> make_relu_activator() {
+        return activator_t<T>(fast_relu_v<T>, relu_derivative_v<T>);
+    }
+
+    // to be used only before crossentropy_output_layer_t
+    template<typename T>
+    activator_t<T> make_softmax_activator() {
+        return activator_t<T>(fast_softmax_v<T>, ones_v<T>);
+    }
+}
+
+#endif // ACTIVATIONS_H
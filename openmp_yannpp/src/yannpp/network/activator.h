@@ -1,33 +1,120 @@
 #ifndef ACTIVATOR_H
 #define ACTIVATOR_H
 
+#include <cassert>
 #include <functional>
 
 #include <yannpp/common/array3d.h>
+#include <yannpp/common/array4d.h>
 
 namespace yannpp {
+    // argument of the derivative function: input of activation z
+    // or its result a = f(z) (e.g. sigmoid'(z) = a * (1 - a))
+    enum struct derivative_arg {
+        input,
+        activation
+    };
+
     template<typename T>
     class activator_t {
         using activator_func_t = std::function<array3d_t<T>(const array3d_t<T>&)>;
     public:
         activator_t(activator_func_t const &activation_func,
-                    activator_func_t const &derivative):
+                    activator_func_t const &derivative,
+                    derivative_arg arg = derivative_arg::input):
             activation_func_(activation_func),
-            derivative_(derivative)
+            derivative_(derivative),
+            derivative_arg_(arg)
         { }
 
         activator_t(activator_t const &other):
             activation_func_(other.activation_func_),
-            derivative_(other.derivative_)
+            derivative_(other.derivative_),
+            derivative_arg_(other.derivative_arg_)
         { }
 
     public:
         array3d_t<T> activate(array3d_t<T> const &v) const { return activation_func_(v); }
         array3d_t<T> derivative(array3d_t<T> const &v) const { return derivative_(v); }
+        // functions are applied to each sample separately (e.g. softmax is per sample)
+        array4d_t<T> activate(array4d_t<T> const &v) const { return apply(activation_func_, v); }
+        array4d_t<T> derivative(array4d_t<T> const &v) const { return apply(derivative_, v); }
+
+        inline derivative_arg get_derivative_arg() const { return derivative_arg_; }
+
+        // activation which also keeps a copy of the result in cache
+        // if derivative is computed from it (cache is left untouched otherwise)
+        array3d_t<T> activate(array3d_t<T> const &z, array3d_t<T> &cache) const {
+            array3d_t<T> a = activation_func_(z);
+            if (derivative_arg_ == derivative_arg::activation) { cache = a.clone(); }
+            return a;
+        }
+
+        array4d_t<T> activate(array4d_t<T> const &z, array4d_t<T> &cache) const {
+            array4d_t<T> a = apply(activation_func_, z);
+            if (derivative_arg_ == derivative_arg::activation) { cache = a.clone(); }
+            return a;
+        }
+
+        // delta = derivative(z) [X] error, computed in place of error
+        array3d_t<T> delta(array3d_t<T> const &z, array3d_t<T> &&error) const {
+            if (derivative_arg_ == derivative_arg::activation) {
+                return delta_impl(z, activation_func_(z), std::move(error));
+            }
+            return delta_impl(z, z, std::move(error));
+        }
+
+        // same with activation a = f(z) cached by activate(z, cache)
+        array3d_t<T> delta(array3d_t<T> const &z, array3d_t<T> const &cache, array3d_t<T> &&error) const {
+            return delta_impl(z, (derivative_arg_ == derivative_arg::activation) ? cache : z, std::move(error));
+        }
+
+        array4d_t<T> delta(array4d_t<T> const &z, array4d_t<T> &&error) const {
+            if (derivative_arg_ == derivative_arg::activation) {
+                return delta_impl(z, apply(activation_func_, z), std::move(error));
+            }
+            return delta_impl(z, z, std::move(error));
+        }
+
+        array4d_t<T> delta(array4d_t<T> const &z, array4d_t<T> const &cache, array4d_t<T> &&error) const {
+            return delta_impl(z, (derivative_arg_ == derivative_arg::activation) ? cache : z, std::move(error));
+        }
+
+    private:
+        array3d_t<T> delta_impl(array3d_t<T> const &z, array3d_t<T> const &arg, array3d_t<T> &&error) const {
+            assert(arg.size() == error.size());
+            array3d_t<T> d = derivative_(arg);
+            error.assign(error * d);
+            error.reshape(z.shape());
+            return std::move(error);
+        }
+
+        array4d_t<T> delta_impl(array4d_t<T> const &z, array4d_t<T> const &arg, array4d_t<T> &&error) const {
+            assert(arg.size() == error.size());
+            const size_t batch_size = arg.batch_size();
+            const size_t size = arg.shape().capacity();
+            for (size_t n = 0; n < batch_size; n++) {
+                array3d_t<T> d = derivative_(arg.get(n));
+                T *e = error.sample(n);
+                evaluate(array_ref_t<T>(e, size) * d, e, size);
+            }
+            error.reshape(z.shape());
+            return std::move(error);
+        }
+
+        static array4d_t<T> apply(activator_func_t const &f, array4d_t<T> const &v) {
+            const size_t batch_size = v.batch_size();
+            array4d_t<T> result(batch_size, v.shape(), T(0));
+            for (size_t n = 0; n < batch_size; n++) {
+                result.set(n, f(v.get(n)));
+            }
+            return result;
+        }
 
     private:
         activator_func_t activation_func_;
         activator_func_t derivative_;
+        derivative_arg derivative_arg_;
     };
 }
 
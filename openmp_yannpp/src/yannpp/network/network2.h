@@ -6,7 +6,9 @@
 #include <tuple>
 #include <memory>
 
+#include <yannpp/common/array4d.h>
 #include <yannpp/common/cpphelpers.h>
+#include <yannpp/common/execution_context.h>
 #include <yannpp/common/log.h>
 #include <yannpp/optimizer/optimizer.h>
 #include <yannpp/layers/fullyconnectedlayer.h>
@@ -18,17 +20,34 @@ namespace yannpp {
     public:
         using data_type = T;
         using t_d = array3d_t<data_type>;
+        using t_b = array4d_t<data_type>;
         using training_data = std::vector<std::tuple<t_d, t_d>>;
         using layer_type = std::shared_ptr<layer_base_t<data_type>>;
 
     public:
-        network2_t(std::initializer_list<layer_type> layers):
-            layers_(layers)
-        {}
+        network2_t(std::initializer_list<layer_type> layers,
+                   execution_context_t const &context = get_default_execution_context()):
+            layers_(layers),
+            context_(std::make_shared<execution_context_t>(context))
+        {
+            attach_context();
+        }
+
+        network2_t(std::vector<layer_type> &&layers,
+                   execution_context_t const &context = get_default_execution_context()):
+            layers_(std::move(layers)),
+            context_(std::make_shared<execution_context_t>(context))
+        {
+            attach_context();
+        }
 
-        network2_t(std::vector<layer_type> &&layers):
-            layers_(std::move(layers))
-        {}
+    public:
+        // context is shared by all layers of the network
+        execution_context_t const &get_execution_context() const { return *context_; }
+        void set_execution_context(execution_context_t const &context) {
+            *context_ = context;
+            context_->bind_threads();
+        }
 
     public:
         void init_layers() {
@@ -95,35 +114,50 @@ namespace yannpp {
         void update_mini_batch(training_data const &data,
                                std::vector<size_t> const &indices,
                                optimizer_t<network2_t::data_type> const &strategy) {
-            for (auto i: indices) {
-                backpropagate(INPUT(i), RESULT(i));
+            const size_t batch_size = indices.size();
+            t_b input(batch_size, INPUT(indices[0]).shape(), 0);
+            t_b result(batch_size, RESULT(indices[0]).shape(), 0);
+            for (size_t n = 0; n < batch_size; n++) {
+                input.set(n, INPUT(indices[n]));
+                result.set(n, RESULT(indices[n]));
             }
 
+            backpropagate(std::move(input), std::move(result));
+
             for (auto &layer: layers_) {
                 layer->optimize(strategy);
             }
         }
 
-        // runs a loop of propagation of inputs and backpropagation of errors
-        // back to the beginning with weights and biases updates as a result
-        void backpropagate(t_d const &x, t_d const &result) {
+        // runs a loop of propagation of the whole minibatch and backpropagation of errors
+        // back to the beginning with weights and biases gradients accumulated in layers
+        void backpropagate(t_b &&x, t_b &&result) {
             const size_t layers_size = layers_.size();
-            array3d_t<network2_t::data_type> input(x);
+            t_b input(std::move(x));
 
             // feedforward input
             for (size_t i = 0; i < layers_size; i++) {
-                input = layers_[i]->feedforward(std::move(input));
+                input = layers_[i]->feedforward_batch(std::move(input));
             }
 
             // backpropagate error
-            array3d_t<network2_t::data_type> error(result);
+            t_b error(std::move(result));
             for (size_t i = layers_size; i-- > 0;) {
-                error = layers_[i]->backpropagate(std::move(error));
+                error = layers_[i]->backpropagate_batch(std::move(error));
+            }
+        }
+
+        void attach_context() {
+            for (auto &layer: layers_) {
+                layer->set_execution_context(*context_);
             }
+            context_->bind_threads();
         }
 
     private:
         std::vector<std::shared_ptr<layer_base_t<data_type>>> layers_;
+        // shared so that copies of the network keep layers pointing to live context
+        std::shared_ptr<execution_context_t> context_;
     };
 }
 
@@ -22,14 +22,15 @@ namespace yannpp {
         virtual void update_bias(array3d_t<T> &b, array3d_t<T> &nabla_b) const override {
             // b = b - eta/minibatch_size * gradient_b
             T scale = learning_rate_ / (T)minibatch_size_;
-            b.add(nabla_b.mul(-scale));
+            b.assign(b - scale * nabla_b);
         }
 
         virtual void update_weights(array3d_t<T> &w, array3d_t<T> &nabla_w) const override {
             // w = w - eta/minibatch_size * gradient_w
             T scale = learning_rate_;
             T decay = T(1) - learning_rate_*weight_decay_ / (T)input_size_;
-            w.mul(decay).add(nabla_w.mul(-scale));
+            // single pass over both arrays, nabla_w is left untouched
+            w.assign(decay * w - scale * nabla_w);
         }
 
     private: